@@ -0,0 +1,206 @@
+#include <linux/atomic.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+#include "account.h"
+
+char *account_type_names[] = { "kmalloc", "vmalloc", "pages", "vmap" };
+
+/* live bytes are global, allocations count to the phase that is current.
+ * Concurrent threads all count to the same phase. */
+static atomic64_t account_live[ACCOUNT_TYPES];
+static s64 account_base[ACCOUNT_TYPES];
+static struct {
+	atomic64_t peak[ACCOUNT_TYPES], total[ACCOUNT_TYPES];
+} account_phases[PHASES];
+static int account_current;
+
+static void account_peak(int phase, int type, s64 live) {
+	s64 old, peak = atomic64_read(&account_phases[phase].peak[type]);
+	while (live > peak) {
+		if ((old = atomic64_cmpxchg(&account_phases[phase].peak[type], peak, live)) == peak)
+			break;
+		peak = old;
+	}
+}
+
+static void account_add(int type, s64 bytes) {
+	int phase = READ_ONCE(account_current);
+	s64 live = atomic64_add_return(bytes, &account_live[type]);
+	if (bytes > 0) {
+		atomic64_add(bytes, &account_phases[phase].total[type]);
+		account_peak(phase, type, live);
+	}
+}
+
+/* start a new measurement, peaks count from what is live now */
+void account_reset(void) {
+	int i, j;
+	for (j = 0; j < ACCOUNT_TYPES; j++)
+		account_base[j] = atomic64_read(&account_live[j]);
+	for (i = 0; i < PHASES; i++)
+		for (j = 0; j < ACCOUNT_TYPES; j++) {
+			atomic64_set(&account_phases[i].peak[j], account_base[j]);
+			atomic64_set(&account_phases[i].total[j], 0);
+		}
+	WRITE_ONCE(account_current, ALLOC_PHASE);
+}
+
+void account_phase(enum phase phase) {
+	int j;
+	WRITE_ONCE(account_current, phase);
+	for (j = 0; j < ACCOUNT_TYPES; j++)
+		account_peak(phase, j, atomic64_read(&account_live[j]));
+}
+
+void account_get(struct account account[PHASES]) {
+	int i, j;
+	for (i = 0; i < PHASES; i++)
+		for (j = 0; j < ACCOUNT_TYPES; j++) {
+			account[i].peak[j] = max_t(s64, 0, atomic64_read(&account_phases[i].peak[j]) - account_base[j]);
+			account[i].total[j] = atomic64_read(&account_phases[i].total[j]);
+		}
+}
+
+s64 account_sum(s64 bytes[ACCOUNT_TYPES]) {
+	s64 sum = 0;
+	int j;
+	for (j = 0; j < ACCOUNT_TYPES; j++)
+		sum += bytes[j];
+	return sum;
+}
+
+void account_other(enum account_type type, s64 bytes) {
+	account_add(type, bytes);
+}
+
+/* kmalloc rounds up to its size classes, ksize knows the real size */
+void *account_kmalloc(size_t size, gfp_t gfp) {
+	void *p;
+	if ((p = kmalloc(size, gfp)))
+		account_add(ACCOUNT_KMALLOC, ksize(p));
+	return p;
+}
+void *account_kzalloc(size_t size, gfp_t gfp) {
+	return account_kmalloc(size, gfp | __GFP_ZERO);
+}
+void account_kfree(const void *p) {
+	if (!p) return;
+	account_add(ACCOUNT_KMALLOC, -(s64)ksize(p));
+	kfree(p);
+}
+
+/* slab caches count as kmalloc, with the object size of the cache */
+void *account_kmem_cache_alloc(struct kmem_cache *cache, gfp_t gfp) {
+	void *p;
+	if ((p = kmem_cache_alloc(cache, gfp)))
+		account_add(ACCOUNT_KMALLOC, kmem_cache_size(cache));
+	return p;
+}
+void account_kmem_cache_free(struct kmem_cache *cache, void *p) {
+	if (!p) return;
+	account_add(ACCOUNT_KMALLOC, -(s64)kmem_cache_size(cache));
+	kmem_cache_free(cache, p);
+}
+
+/* kvmalloc goes to vmalloc when kmalloc cannot serve the size, the
+ * address tells which one it was */
+size_t account_kvsize(const void *p, size_t size) {
+	if (!p) return 0;
+	return is_vmalloc_addr(p) ? PAGE_ALIGN(size) : ksize(p);
+}
+void *account_kvmalloc_array(size_t n, size_t size, gfp_t gfp) {
+	void *p;
+	if ((p = kvmalloc_array(n, size, gfp)))
+		account_add(is_vmalloc_addr(p) ? ACCOUNT_VMALLOC : ACCOUNT_KMALLOC, account_kvsize(p, n * size));
+	return p;
+}
+void account_kvfree(const void *p, size_t size) {
+	if (!p) return;
+	account_add(is_vmalloc_addr(p) ? ACCOUNT_VMALLOC : ACCOUNT_KMALLOC, -(s64)account_kvsize(p, size));
+	kvfree(p);
+}
+
+void *account_vmalloc(size_t size) {
+	void *p;
+	if ((p = vmalloc(size)))
+		account_add(ACCOUNT_VMALLOC, PAGE_ALIGN(size));
+	return p;
+}
+void account_vfree(const void *p, size_t size) {
+	if (!p) return;
+	account_add(ACCOUNT_VMALLOC, -(s64)PAGE_ALIGN(size));
+	vfree(p);
+}
+
+/* vmalloc_huge came with 5.18, older kernels have no huge vmalloc mappings */
+void *account_vmalloc_huge(size_t size) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 18, 0)
+	void *p;
+	if ((p = vmalloc_huge(size, GFP_KERNEL)))
+		account_add(ACCOUNT_VMALLOC, vmalloc_huge_size(size));
+	return p;
+#else
+	return NULL;
+#endif
+}
+void account_vfree_huge(const void *p, size_t size) {
+	if (!p) return;
+	account_add(ACCOUNT_VMALLOC, -(s64)vmalloc_huge_size(size));
+	vfree(p);
+}
+
+struct page *account_alloc_pages(gfp_t gfp, unsigned int order) {
+	struct page *page;
+	if ((page = alloc_pages(gfp, order)))
+		account_add(ACCOUNT_PAGES, PAGE_SIZE << order);
+	return page;
+}
+void account_free_pages(struct page *page, unsigned int order) {
+	if (!page) return;
+	account_add(ACCOUNT_PAGES, -(s64)(PAGE_SIZE << order));
+	__free_pages(page, order);
+}
+
+void *account_alloc_pages_exact(size_t size, gfp_t gfp) {
+	void *p;
+	if ((p = alloc_pages_exact(size, gfp)))
+		account_add(ACCOUNT_PAGES, PAGE_ALIGN(size));
+	return p;
+}
+void account_free_pages_exact(void *p, size_t size) {
+	if (!p) return;
+	account_add(ACCOUNT_PAGES, -(s64)PAGE_ALIGN(size));
+	free_pages_exact(p, size);
+}
+
+/* mappings only cost virtual address space */
+void *account_vmap(struct page **pages, unsigned int count) {
+	void *p;
+	if ((p = vmap(pages, count, VM_MAP, PAGE_KERNEL)))
+		account_add(ACCOUNT_VMAP, (s64)count * PAGE_SIZE);
+	return p;
+}
+void account_vunmap(const void *p, unsigned int count) {
+	if (!p) return;
+	account_add(ACCOUNT_VMAP, -(s64)count * PAGE_SIZE);
+	vunmap(p);
+}
+void *account_vm_map_ram(struct page **pages, unsigned int count, int node) {
+	void *p;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+	if ((p = vm_map_ram(pages, count, node)))
+#else
+	if ((p = vm_map_ram(pages, count, node, PAGE_KERNEL)))
+#endif
+		account_add(ACCOUNT_VMAP, (s64)count * PAGE_SIZE);
+	return p;
+}
+void account_vm_unmap_ram(const void *p, unsigned int count) {
+	if (!p) return;
+	account_add(ACCOUNT_VMAP, -(s64)count * PAGE_SIZE);
+	vm_unmap_ram(p, count);
+}
@@ -0,0 +1,57 @@
+#ifndef account_h_INCLUDED
+#define account_h_INCLUDED
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include "stats.h"
+
+/* allocators tracked by the wrappers, vmap is the mapped virtual range */
+enum account_type { ACCOUNT_KMALLOC, ACCOUNT_VMALLOC, ACCOUNT_PAGES, ACCOUNT_VMAP, ACCOUNT_TYPES };
+extern char *account_type_names[];
+
+/* bytes of one phase. peak is the most that was live at once, counted from
+ * account_reset, total is everything allocated during the phase. */
+struct account {
+	s64 peak[ACCOUNT_TYPES], total[ACCOUNT_TYPES];
+};
+
+void account_reset(void);
+void account_phase(enum phase phase);
+void account_get(struct account account[PHASES]);
+s64 account_sum(s64 bytes[ACCOUNT_TYPES]);
+
+/* allocations made by someone else, like zfs, negative bytes for frees */
+void account_other(enum account_type type, s64 bytes);
+
+/* wrappers, frees take the size where the allocator does not know it */
+void *account_kmalloc(size_t size, gfp_t gfp);
+void *account_kzalloc(size_t size, gfp_t gfp);
+void account_kfree(const void *p);
+struct kmem_cache;
+void *account_kmem_cache_alloc(struct kmem_cache *cache, gfp_t gfp);
+void account_kmem_cache_free(struct kmem_cache *cache, void *p);
+void *account_kvmalloc_array(size_t n, size_t size, gfp_t gfp);
+void account_kvfree(const void *p, size_t size);
+size_t account_kvsize(const void *p, size_t size);
+void *account_vmalloc(size_t size);
+void account_vfree(const void *p, size_t size);
+void *account_vmalloc_huge(size_t size);
+void account_vfree_huge(const void *p, size_t size);
+struct page *account_alloc_pages(gfp_t gfp, unsigned int order);
+void account_free_pages(struct page *page, unsigned int order);
+void *account_alloc_pages_exact(size_t size, gfp_t gfp);
+void account_free_pages_exact(void *p, size_t size);
+void *account_vmap(struct page **pages, unsigned int count);
+void account_vunmap(const void *p, unsigned int count);
+void *account_vm_map_ram(struct page **pages, unsigned int count, int node);
+void account_vm_unmap_ram(const void *p, unsigned int count);
+
+/* vmalloc_huge maps with PMDs once the size reaches one, on arches with
+ * huge vmalloc. Everywhere else it falls back to pages */
+static inline size_t vmalloc_huge_size(size_t size) {
+	return IS_ENABLED(CONFIG_HAVE_ARCH_HUGE_VMALLOC) && size >= PMD_SIZE
+		? ALIGN(size, PMD_SIZE) : PAGE_ALIGN(size);
+}
+
+#endif // account_h_INCLUDED
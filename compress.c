@@ -1,66 +1,182 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
 #include <linux/init.h>
 #include <linux/fs.h>
+#include <linux/highmem.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/scatterlist.h>
+#include <linux/uio.h>
 #include <linux/smp.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
 
 #include "lz4/lz4.h"
 #include "zstd/zstd.h"
 #include "zfs/include/sys/zstd/zstd.h"
+#ifdef COMPBM_ABD
+#include "zfs/include/sys/abd.h"
+#endif
 
 #include "compress.h"
+#include "account.h"
+#include "stats.h"
 #define SIZE(a) (sizeof(a)/sizeof(*a))
 
-/* in non-zfs versions we need to initialize working contexts */
-void *lz4_workmem, *zstd_cworkmem, *zstd_dworkmem;
-ZSTD_compressionParameters zstd_cparam;
-ZSTD_parameters zstd_param;
-ZSTD_CCtx *zstd_ccontext;
-ZSTD_DCtx *zstd_dcontext;
-LZ4_stream_t *lz4_stream;
-LZ4_streamDecode_t *lz4_streamDecode;
+/* in non-zfs versions we need to initialize working contexts.
+ * Every thread compressing at the same time needs its own one. */
+struct compress_ctx {
+	void *lz4_workmem, *zstd_cworkmem, *zstd_dworkmem;
+	ZSTD_parameters zstd_param;
+	ZSTD_CCtx *zstd_ccontext;
+	ZSTD_DCtx *zstd_dcontext;
+	ZSTD_DStream *zstd_dstream;
+	void *zstd_dsworkmem;
+	ZSTD_CStream *zstd_cstream;
+	void *zstd_csworkmem;
+	void *iov_ring; /* chunks decompressed before going out through an iov_iter */
+	LZ4_stream_t *lz4_stream;
+	LZ4_streamDecode_t *lz4_streamDecode;
+	LZ4_streamHC_t *lz4hc_stream; /* also the workmem of LZ4_compress_HC */
+	struct zstd_mt *zstd_mt;
+	size_t zstd_cworkmem_size, zstd_dworkmem_size, zstd_dsworkmem_size, zstd_csworkmem_size;
+	size_t workspace; /* bytes allocated for this context */
+};
+
+/* contexts of the selected codec, one cached per cpu like zswap keeps them.
+ * compress_get takes the one of the current cpu with this_cpu_xchg and
+ * compress_put gives it back with this_cpu_cmpxchg, so nobody waits on a
+ * lock and a context is never shared. A miss builds a new context. */
+static struct compress_ctx * __percpu *compress_pool;
+static struct compress_api compress_pool_api;
+static size_t compress_pool_size;
+
+/* The api works on size_t, but lz4 and the zfs zstd header take int and
+ * 32 bit sizes. Those back ends get at most COMPRESS_CHUNK bytes at once:
+ * a larger input is cut into chunks, each stored behind its compressed size
+ * as le32, and decompression cuts dest the same way. Inputs up to
+ * COMPRESS_CHUNK stay a single plain block. */
+#define COMPRESS_CHUNK ((size_t)1 << 30)
+typedef int (*chunk_cc)(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s, int level);
+typedef int (*chunk_dc)(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s);
+
+/* room left in dest as an int, larger capacities do not matter to a chunk */
+static inline int int_cap(size_t size) {
+	return min_t(size_t, size, INT_MAX);
+}
+
+static size_t chunked_compress(struct compress_ctx *ctx, void *dest, size_t dest_s, void *src, size_t src_s, int level, chunk_cc cc) {
+	size_t in, out = 0, len;
+	int ret;
+
+	if (src_s <= COMPRESS_CHUNK)
+		return max(cc(ctx, dest, int_cap(dest_s), src, src_s, level), 0);
+	for (in = 0; in < src_s; in += len) {
+		len = min(COMPRESS_CHUNK, src_s - in);
+		if (out + sizeof(u32) >= dest_s)
+			return 0;
+		ret = cc(ctx, dest + out + sizeof(u32), int_cap(dest_s - out - sizeof(u32)), src + in, len, level);
+		if (ret <= 0)
+			return 0;
+		put_unaligned_le32(ret, dest + out);
+		out += sizeof(u32) + ret;
+	}
+	return out;
+}
+
+static size_t chunked_decompress(struct compress_ctx *ctx, void *dest, size_t dest_s, void *src, size_t src_s, chunk_dc dc) {
+	size_t in = 0, out, len, chunk_s;
+
+	if (dest_s <= COMPRESS_CHUNK)
+		return max(dc(ctx, dest, dest_s, src, int_cap(src_s)), 0);
+	for (out = 0; out < dest_s; out += len) {
+		len = min(COMPRESS_CHUNK, dest_s - out);
+		if (in + sizeof(u32) > src_s)
+			return 0;
+		chunk_s = get_unaligned_le32(src + in);
+		in += sizeof(u32);
+		if (chunk_s > src_s - in || dc(ctx, dest + out, len, src + in, chunk_s) <= 0)
+			return 0;
+		in += chunk_s;
+	}
+	return out;
+}
+
+static int zfs_zstd_compress_chunk(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s, int level) {
+	return zfs_zstd_compress(src, dest, src_s, dest_s, level);
+}
+/* zfs_zstd_decompress returns 0 on success */
+static int zfs_zstd_decompress_chunk(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s) {
+	return zfs_zstd_decompress(src, dest, src_s, dest_s, 0) ? -1 : dest_s;
+}
+static int lz4_compress_chunk(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s, int level) {
+	return LZ4_compress_fast(src, dest, src_s, dest_s, level, ctx->lz4_workmem);
+}
+static int lz4_decompress_chunk(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s) {
+	return LZ4_decompress_fast(src, dest, dest_s);
+}
+static int lz4hc_compress_chunk(struct compress_ctx *ctx, void *dest, int dest_s, void *src, int src_s, int level) {
+	return LZ4_compress_HC(src, dest, src_s, dest_s, level, ctx->lz4hc_stream);
+}
 
-int _memcpy_compress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
+size_t _memcpy_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
 	memcpy(dest, src, src_s);
 	return src_s;
 }
-int _memcpy_decompress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
+size_t _memcpy_decompress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
 	memcpy(dest, src, src_s);
 	return src_s;
 }
-int _zfs_zstd_compress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
-	return zfs_zstd_compress(src, dest, src_s, dest_s, level);
+size_t _zfs_zstd_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	return chunked_compress(ctx, dest, dest_s, src, src_s, level, zfs_zstd_compress_chunk);
 }
-int _zfs_zstd_decompress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
-	return zfs_zstd_decompress(src, dest, src_s, dest_s, 0);
+size_t _zfs_zstd_decompress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	return chunked_decompress(ctx, dest, dest_s, src, src_s, zfs_zstd_decompress_chunk);
 }
-int _lz4_compress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
-	return LZ4_compress_fast(src, dest, src_s, dest_s, level, lz4_workmem);
+size_t _lz4_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	return chunked_compress(ctx, dest, dest_s, src, src_s, level, lz4_compress_chunk);
 }
-int _lz4_decompress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
-	return LZ4_decompress_fast(src, dest, dest_s);
+size_t _lz4_decompress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	return chunked_decompress(ctx, dest, dest_s, src, src_s, lz4_decompress_chunk);
+}
+size_t _lz4hc_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	return chunked_compress(ctx, dest, dest_s, src, src_s, level, lz4hc_compress_chunk);
 }
-int _zstd_compress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
-	return ZSTD_compressCCtx(zstd_ccontext, dest, dest_s, src, src_s, zstd_param);
+/* zstd takes size_t itself, its frames have no size limit */
+size_t _zstd_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	size_t ret = ZSTD_compressCCtx(ctx->zstd_ccontext, dest, dest_s, src, src_s, ctx->zstd_param);
+	return ZSTD_isError(ret) ? 0 : ret;
 }
-int _zstd_decompress(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
-	return ZSTD_decompressDCtx(zstd_dcontext, dest, dest_s, src, src_s);
+size_t _zstd_decompress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	size_t ret = ZSTD_decompressDCtx(ctx->zstd_dcontext, dest, dest_s, src, src_s);
+	return ZSTD_isError(ret) ? 0 : ret;
 }
-int blocks_lz4_compress_stream(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
+size_t blocks_lz4_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
 	struct block_array bba = buffer->block_array;
 	int i;
-	int frame_size, compressed_size = 0;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	/* every run starts a fresh stream */
+	memset(ctx->lz4_stream, 0, sizeof(LZ4_stream_t));
 
 	/* compress frames */
 	for (i = 0; i < bba.bs; i++) {
 		frame_size = LZ4_compress_fast_continue(
-			lz4_stream, bba.b[i], &((char *)dest)[compressed_size],
+			ctx->lz4_stream, bba.b[i], &((char *)dest)[compressed_size],
 			/* edge case for last frame */
 			(i + 1) < bba.bs ? bba.block_size : src_s - ((bba.bs - 1) * bba.block_size),
-			dest_s - compressed_size, level
+			int_cap(dest_s - compressed_size), level
 		);
 		if (frame_size <= 0)
 			return 0;
@@ -69,15 +185,18 @@ int blocks_lz4_compress_stream(union buffer *buffer, void *dest, int dest_s, voi
 	
 	return compressed_size;
 }
-int blocks_lz4_decompress_stream(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
+size_t blocks_lz4_decompress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
 	struct block_array bba = buffer->block_array;
 	int i;
-	int frame_size, offset = 0;
+	int frame_size;
+	size_t offset = 0;
+
+	LZ4_setStreamDecode(ctx->lz4_streamDecode, NULL, 0);
 
 	/* decompress frames */
 	for (i = 0; i < bba.bs; i++) {
 		frame_size = LZ4_decompress_fast_continue(
-			lz4_streamDecode, &((char*)src)[offset], &((char*)dest)[i * bba.block_size],
+			ctx->lz4_streamDecode, &((char*)src)[offset], &((char*)dest)[i * bba.block_size],
 			/* edge case for last frame */
 			(i + 1) < bba.bs ? bba.block_size : dest_s - ((bba.bs - 1) * bba.block_size)
 		);
@@ -90,15 +209,17 @@ int blocks_lz4_decompress_stream(union buffer *buffer, void *dest, int dest_s, v
 }
 
 /* same as blocks_lz4_compress_stream, just with PAGE_SIZE insted block_size */
-int pages_lz4_compress_stream(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level) {
+size_t pages_lz4_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
 	struct page_array bpa = buffer->page_array;
 	int i;
-	int frame_size, compressed_size = 0;
+	int frame_size;
+	size_t compressed_size = 0;
 
+	memset(ctx->lz4_stream, 0, sizeof(LZ4_stream_t));
 	for (i = 0; i < bpa.ps; i++) {
 		frame_size = LZ4_compress_fast_continue(
-			lz4_stream, page_address(bpa.p[i]), &((char *)dest)[compressed_size],
-			PAGE_SIZE, dest_s - compressed_size, level
+			ctx->lz4_stream, page_address(bpa.p[i]), &((char *)dest)[compressed_size],
+			PAGE_SIZE, int_cap(dest_s - compressed_size), level
 		);
 		if (frame_size <= 0)
 			return 0;
@@ -108,14 +229,16 @@ int pages_lz4_compress_stream(union buffer *buffer, void *dest, int dest_s, void
 	return compressed_size;
 }
 
-int pages_lz4_decompress_stream(union buffer *buffer, void *dest, int dest_s, void *src, int src_s) {
+size_t pages_lz4_decompress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
 	struct page_array bpa = buffer->page_array;
 	int i;
-	int frame_size, offset = 0;
+	int frame_size;
+	size_t offset = 0;
 
+	LZ4_setStreamDecode(ctx->lz4_streamDecode, NULL, 0);
 	for (i = 0; i < bpa.ps; i++) {
 		frame_size = LZ4_decompress_fast_continue(
-			lz4_streamDecode, &((char*)src)[offset], &((char*)dest)[i * PAGE_SIZE],
+			ctx->lz4_streamDecode, &((char*)src)[offset], &((char*)dest)[i * PAGE_SIZE],
 			PAGE_SIZE
 		);
 		if (frame_size <= 0)
@@ -125,59 +248,984 @@ int pages_lz4_decompress_stream(union buffer *buffer, void *dest, int dest_s, vo
 	
 	return offset;
 }
+
+/* HC versions of the stream compressors, decompression is the same as for
+ * blocks_lz4_decompress_stream and pages_lz4_decompress_stream */
+size_t blocks_lz4hc_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct block_array bba = buffer->block_array;
+	int i;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	LZ4_resetStreamHC(ctx->lz4hc_stream, level);
+	for (i = 0; i < bba.bs; i++) {
+		frame_size = LZ4_compress_HC_continue(
+			ctx->lz4hc_stream, bba.b[i], &((char *)dest)[compressed_size],
+			/* edge case for last frame */
+			(i + 1) < bba.bs ? bba.block_size : src_s - ((bba.bs - 1) * bba.block_size),
+			int_cap(dest_s - compressed_size)
+		);
+		if (frame_size <= 0)
+			return 0;
+		compressed_size += frame_size;
+	}
+
+	return compressed_size;
+}
+
+size_t pages_lz4hc_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct page_array bpa = buffer->page_array;
+	int i;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	LZ4_resetStreamHC(ctx->lz4hc_stream, level);
+	for (i = 0; i < bpa.ps; i++) {
+		frame_size = LZ4_compress_HC_continue(
+			ctx->lz4hc_stream, page_address(bpa.p[i]), &((char *)dest)[compressed_size],
+			PAGE_SIZE, int_cap(dest_s - compressed_size)
+		);
+		if (frame_size <= 0)
+			return 0;
+		compressed_size += frame_size;
+	}
+
+	return compressed_size;
+}
+
+/* zstd frames fed block by block or page by page. ZSTD_compressContinue
+ * would compress straight from the segments, but with non-contiguous input
+ * it keeps only the previous segment as window, about a page here. The
+ * CStream copies the segments into its own window instead, so ratios
+ * compare with zstd_N. */
+static int zstd_stream_piece(struct compress_ctx *ctx, ZSTD_outBuffer *out, void *src, size_t len) {
+	ZSTD_inBuffer in = { src, len, 0 };
+	while (in.pos < in.size)
+		if (ZSTD_isError(ZSTD_compressStream(ctx->zstd_cstream, out, &in)) || out->pos == out->size)
+			return 1;
+	return 0;
+}
+/* anything left to flush means dest was too small */
+static size_t zstd_stream_end(struct compress_ctx *ctx, ZSTD_outBuffer *out) {
+	return ZSTD_endStream(ctx->zstd_cstream, out) ? 0 : out->pos;
+}
+
+size_t blocks_zstd_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct block_array bba = buffer->block_array;
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+	size_t len;
+	int i;
+
+	if (ZSTD_isError(ZSTD_resetCStream(ctx->zstd_cstream, src_s)))
+		return 0;
+	for (i = 0; i < bba.bs; i++) {
+		/* edge case for last block */
+		len = (i + 1) < bba.bs ? bba.block_size : src_s - ((bba.bs - 1) * bba.block_size);
+		if (zstd_stream_piece(ctx, &out, bba.b[i], len))
+			return 0;
+	}
+
+	return zstd_stream_end(ctx, &out);
+}
+
+size_t pages_zstd_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct page_array bpa = buffer->page_array;
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+	size_t len;
+	int i;
+
+	if (ZSTD_isError(ZSTD_resetCStream(ctx->zstd_cstream, src_s)))
+		return 0;
+	for (i = 0; i < bpa.ps; i++) {
+		len = (i + 1) < bpa.ps ? PAGE_SIZE : src_s - ((bpa.ps - 1) * PAGE_SIZE);
+		if (zstd_stream_piece(ctx, &out, page_address(bpa.p[i]), len))
+			return 0;
+	}
+
+	return zstd_stream_end(ctx, &out);
+}
+
+/* scatterlists are walked with sg_miter and every piece is fed to the
+ * stream as it is, without linearizing the list first. Pieces stay mapped
+ * for the whole run, lowmem pages keep their address after sg_miter_next. */
+size_t sg_lz4_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct sg_list *bsg = &buffer->sg_list;
+	struct sg_mapping_iter miter;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	memset(ctx->lz4_stream, 0, sizeof(LZ4_stream_t));
+	sg_miter_start(&miter, bsg->sg, bsg->nents, SG_MITER_FROM_SG);
+	while (sg_miter_next(&miter)) {
+		frame_size = LZ4_compress_fast_continue(
+			ctx->lz4_stream, miter.addr, &((char *)dest)[compressed_size],
+			miter.length, int_cap(dest_s - compressed_size), level
+		);
+		if (frame_size <= 0) {
+			compressed_size = 0;
+			break;
+		}
+		compressed_size += frame_size;
+	}
+	sg_miter_stop(&miter);
+
+	return compressed_size;
+}
+
+/* the frames are as long as the pieces of the list */
+size_t sg_lz4_decompress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	struct sg_list *bsg = &buffer->sg_list;
+	struct sg_mapping_iter miter;
+	int frame_size;
+	size_t offset = 0, written = 0;
+
+	LZ4_setStreamDecode(ctx->lz4_streamDecode, NULL, 0);
+	sg_miter_start(&miter, bsg->sg, bsg->nents, SG_MITER_FROM_SG);
+	while (sg_miter_next(&miter)) {
+		frame_size = LZ4_decompress_fast_continue(
+			ctx->lz4_streamDecode, &((char*)src)[offset], &((char*)dest)[written],
+			miter.length
+		);
+		if (frame_size <= 0) {
+			offset = 0;
+			break;
+		}
+		offset += frame_size;
+		written += miter.length;
+	}
+	sg_miter_stop(&miter);
+
+	return offset;
+}
+
+size_t sg_lz4hc_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct sg_list *bsg = &buffer->sg_list;
+	struct sg_mapping_iter miter;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	LZ4_resetStreamHC(ctx->lz4hc_stream, level);
+	sg_miter_start(&miter, bsg->sg, bsg->nents, SG_MITER_FROM_SG);
+	while (sg_miter_next(&miter)) {
+		frame_size = LZ4_compress_HC_continue(
+			ctx->lz4hc_stream, miter.addr, &((char *)dest)[compressed_size],
+			miter.length, int_cap(dest_s - compressed_size)
+		);
+		if (frame_size <= 0) {
+			compressed_size = 0;
+			break;
+		}
+		compressed_size += frame_size;
+	}
+	sg_miter_stop(&miter);
+
+	return compressed_size;
+}
+
+/* one zstd frame through the CStream, like pages_zstd_compress_stream */
+size_t sg_zstd_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct sg_list *bsg = &buffer->sg_list;
+	struct sg_mapping_iter miter;
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+
+	if (ZSTD_isError(ZSTD_resetCStream(ctx->zstd_cstream, src_s)))
+		return 0;
+	sg_miter_start(&miter, bsg->sg, bsg->nents, SG_MITER_FROM_SG);
+	while (sg_miter_next(&miter)) {
+		if (zstd_stream_piece(ctx, &out, miter.addr, miter.length)) {
+			sg_miter_stop(&miter);
+			return 0;
+		}
+	}
+	sg_miter_stop(&miter);
+
+	return zstd_stream_end(ctx, &out);
+}
+
+/* decompression of all zstd streams, with ZSTD_decompressStream into the flat dest */
+size_t _zstd_decompress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	ZSTD_inBuffer in = { src, src_s, 0 };
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+	size_t ret;
+
+	if (ZSTD_isError(ZSTD_resetDStream(ctx->zstd_dstream)))
+		return 0;
+	do {
+		ret = ZSTD_decompressStream(ctx->zstd_dstream, &out, &in);
+		if (ZSTD_isError(ret))
+			return 0;
+	} while (ret && in.pos < in.size && out.pos < out.size);
+
+	return out.pos;
+}
+/* -----------------------------------
+ * iov_iter streams over bio_vec arrays
+ * ----------------------------------- */
+
+/* The compressors walk the iov_iter segment by segment and map every page
+ * in place, like sg_miter does for sg lists, so pieces are at most a page.
+ * The decompressors write out through an iov_iter over the flat check
+ * buffer. Like a driver completing a read they bounce through a ring, LZ4
+ * keeps its 64K dictionary in it and takes back the pieces of the bvecs. */
+#define IOV_CHUNK (16 * 1024)
+#define IOV_RING (4 * 64 * 1024)
+
+/* length of the piece at the position of a bvec iterator, up to the end of
+ * its page */
+static size_t bvec_iter_piece(struct iov_iter *iter) {
+	const struct bio_vec *bv = iter->bvec;
+	size_t off = (bv->bv_offset + iter->iov_offset) % PAGE_SIZE;
+	size_t len = min_t(size_t, bv->bv_len - iter->iov_offset, PAGE_SIZE - off);
+	return min_t(size_t, len, iov_iter_count(iter));
+}
+static struct page *bvec_iter_page(struct iov_iter *iter) {
+	return iter->bvec->bv_page + (iter->bvec->bv_offset + iter->iov_offset) / PAGE_SIZE;
+}
+/* kmap_local_page came in 5.11 */
+static void *bvec_iter_map(struct iov_iter *iter) {
+	size_t off = (iter->bvec->bv_offset + iter->iov_offset) % PAGE_SIZE;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	return kmap_local_page(bvec_iter_page(iter)) + off;
+#else
+	return kmap(bvec_iter_page(iter)) + off;
+#endif
+}
+static void bvec_iter_unmap(struct iov_iter *iter, void *addr) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0)
+	kunmap_local(addr);
+#else
+	kunmap(bvec_iter_page(iter));
+#endif
+}
+
+size_t bvec_lz4_compress_iter(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct iov_iter iter;
+	size_t len;
+	void *addr;
+	int frame_size;
+	size_t compressed_size = 0;
+
+	memset(ctx->lz4_stream, 0, sizeof(LZ4_stream_t));
+	mem_bvec_iter(&iter, buffer, WRITE);
+	while (iov_iter_count(&iter)) {
+		len = bvec_iter_piece(&iter);
+		addr = bvec_iter_map(&iter);
+		frame_size = LZ4_compress_fast_continue(
+			ctx->lz4_stream, addr, &((char *)dest)[compressed_size],
+			len, int_cap(dest_s - compressed_size), level
+		);
+		bvec_iter_unmap(&iter, addr);
+		if (frame_size <= 0)
+			return 0;
+		compressed_size += frame_size;
+		iov_iter_advance(&iter, len);
+	}
+
+	return compressed_size;
+}
+
+/* the frames are as long as the pieces of the bvecs */
+size_t bvec_lz4_decompress_iter(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	struct kvec kvec = { dest, dest_s };
+	struct iov_iter iter, pieces;
+	size_t len, ring = 0;
+	int frame_size;
+	size_t offset = 0;
+
+	LZ4_setStreamDecode(ctx->lz4_streamDecode, NULL, 0);
+	iov_iter_kvec(&iter, ITER_KVEC_DIR(READ), &kvec, 1, dest_s);
+	mem_bvec_iter(&pieces, buffer, WRITE);
+	while (iov_iter_count(&iter) && iov_iter_count(&pieces)) {
+		len = bvec_iter_piece(&pieces);
+		if (ring + PAGE_SIZE > IOV_RING)
+			ring = 0;
+		frame_size = LZ4_decompress_fast_continue(
+			ctx->lz4_streamDecode, &((char*)src)[offset], ctx->iov_ring + ring, len
+		);
+		if (frame_size <= 0)
+			return 0;
+		if (copy_to_iter(ctx->iov_ring + ring, len, &iter) != len)
+			return 0;
+		offset += frame_size;
+		ring += len;
+		iov_iter_advance(&pieces, len);
+	}
+
+	return offset;
+}
+
+/* ZSTD_compressStream keeps its own window, so the pages are fed as they are */
+size_t bvec_zstd_compress_iter(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct iov_iter iter;
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+	size_t len;
+	void *addr;
+	int err;
+
+	if (ZSTD_isError(ZSTD_resetCStream(ctx->zstd_cstream, src_s)))
+		return 0;
+	mem_bvec_iter(&iter, buffer, WRITE);
+	while (iov_iter_count(&iter)) {
+		len = bvec_iter_piece(&iter);
+		addr = bvec_iter_map(&iter);
+		err = zstd_stream_piece(ctx, &out, addr, len);
+		bvec_iter_unmap(&iter, addr);
+		if (err)
+			return 0;
+		iov_iter_advance(&iter, len);
+	}
+
+	return zstd_stream_end(ctx, &out);
+}
+
+size_t bvec_zstd_decompress_iter(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	struct kvec kvec = { dest, dest_s };
+	struct iov_iter iter;
+	ZSTD_inBuffer in = { src, src_s, 0 };
+	ZSTD_outBuffer out;
+	size_t ret;
+
+	if (ZSTD_isError(ZSTD_resetDStream(ctx->zstd_dstream)))
+		return 0;
+	iov_iter_kvec(&iter, ITER_KVEC_DIR(READ), &kvec, 1, dest_s);
+	do {
+		out = (ZSTD_outBuffer) { ctx->iov_ring, min_t(size_t, IOV_CHUNK, iov_iter_count(&iter)), 0 };
+		ret = ZSTD_decompressStream(ctx->zstd_dstream, &out, &in);
+		if (ZSTD_isError(ret) || copy_to_iter(ctx->iov_ring, out.pos, &iter) != out.pos)
+			return 0;
+		/* the frame is not done, but there is no input left to finish it */
+		if (ret && in.pos == in.size && out.pos < out.size)
+			return 0;
+	} while (ret && iov_iter_count(&iter));
+
+	return dest_s - iov_iter_count(&iter);
+}
+
+#ifdef COMPBM_ABD
+/* -------------------------------
+ * zfs abds, borrowed or iterated
+ * ------------------------------- */
+
+/* zio_compress_data borrows a linear copy of the abd and compresses that.
+ * For linear abds that is just the buffer, scatter ones are copied */
+size_t abd_zfs_zstd_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	void *buf;
+	size_t ret;
+
+	if (!(buf = abd_borrow_buf_copy(bab->abd, src_s)))
+		return 0;
+	ret = chunked_compress(ctx, dest, dest_s, buf, src_s, level, zfs_zstd_compress_chunk);
+	abd_return_buf(bab->abd, buf, src_s);
+	return ret;
+}
+
+size_t abd_lz4_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	void *buf;
+	size_t ret;
+
+	if (!(buf = abd_borrow_buf_copy(bab->abd, src_s)))
+		return 0;
+	ret = chunked_compress(ctx, dest, dest_s, buf, src_s, level, lz4_compress_chunk);
+	abd_return_buf(bab->abd, buf, src_s);
+	return ret;
+}
+
+/* abd_iterate_func hands out the abd chunk by chunk, every chunk is fed to
+ * the stream where it is. Callbacks stop the iteration by returning non 0 */
+struct abd_stream {
+	struct compress_ctx *ctx;
+	void *dest, *src;
+	size_t dest_s, offset, written;
+	int level;
+};
+
+static int abd_lz4_compress_chunk(void *buf, size_t len, void *priv) {
+	struct abd_stream *as = priv;
+	int frame_size = LZ4_compress_fast_continue(
+		as->ctx->lz4_stream, buf, as->dest + as->offset,
+		len, int_cap(as->dest_s - as->offset), as->level
+	);
+	if (frame_size <= 0)
+		return 1;
+	as->offset += frame_size;
+	return 0;
+}
+
+size_t abd_lz4_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct abd_stream as = { ctx, dest, src, dest_s, 0, 0, level };
+
+	memset(ctx->lz4_stream, 0, sizeof(LZ4_stream_t));
+	if (abd_iterate_func(buffer->abd_buffer.abd, 0, src_s, abd_lz4_compress_chunk, &as))
+		return 0;
+	return as.offset;
+}
+
+/* the frames are as long as the chunks, so the abd is walked again for them */
+static int abd_lz4_decompress_chunk(void *buf, size_t len, void *priv) {
+	struct abd_stream *as = priv;
+	int frame_size = LZ4_decompress_fast_continue(
+		as->ctx->lz4_streamDecode, as->src + as->offset, as->dest + as->written, len
+	);
+	if (frame_size <= 0)
+		return 1;
+	as->offset += frame_size;
+	as->written += len;
+	return 0;
+}
+
+size_t abd_lz4_decompress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	struct abd_stream as = { ctx, dest, src, dest_s, 0, 0, 0 };
+
+	LZ4_setStreamDecode(ctx->lz4_streamDecode, NULL, 0);
+	if (abd_iterate_func(buffer->abd_buffer.abd, 0, dest_s, abd_lz4_decompress_chunk, &as))
+		return 0;
+	return as.offset;
+}
+
+/* like sg_zstd_compress_stream, the output buffer travels in the stream */
+static int abd_zstd_compress_chunk(void *buf, size_t len, void *priv) {
+	struct abd_stream *as = priv;
+	ZSTD_outBuffer out = { as->dest, as->dest_s, as->offset };
+	int ret = zstd_stream_piece(as->ctx, &out, buf, len);
+	as->offset = out.pos;
+	return ret;
+}
+
+size_t abd_zstd_compress_stream(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct abd_stream as = { ctx, dest, src, dest_s, 0, 0, level };
+	ZSTD_outBuffer out = { dest, dest_s, 0 };
+
+	if (ZSTD_isError(ZSTD_resetCStream(ctx->zstd_cstream, src_s)))
+		return 0;
+	if (abd_iterate_func(buffer->abd_buffer.abd, 0, src_s, abd_zstd_compress_chunk, &as))
+		return 0;
+	out.pos = as.offset;
+	return zstd_stream_end(ctx, &out);
+}
+#endif
+
+/* ---------------------------------------
+ * fixed output slots, like zram pages
+ * --------------------------------------- */
+
+/* LZ4_compress_destSize fills a slot of compress_dest_size bytes with as
+ * much input as fits, the next slot goes on where it stopped. A slot starts
+ * with the le32 size of its block, the rest after the block stays unused.
+ * The output is always a whole number of slots, like objects stored in
+ * zram pages. */
+size_t compress_dest_size = PAGE_SIZE;
+
+static size_t destsize_slot(void) {
+	return max_t(size_t, compress_dest_size, COMPRESS_DEST_MIN);
+}
+
+size_t lz4_compress_destsize(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	size_t in = 0, out = 0, slot = destsize_slot();
+	int len, ret;
+
+	while (in < src_s) {
+		if (out + slot > dest_s)
+			return 0;
+		len = min_t(size_t, src_s - in, LZ4_MAX_INPUT_SIZE);
+		ret = LZ4_compress_destSize(src + in, dest + out + sizeof(u32), &len, slot - sizeof(u32), ctx->lz4_workmem);
+		if (ret <= 0 || len <= 0)
+			return 0;
+		put_unaligned_le32(ret, dest + out);
+		in += len;
+		out += slot;
+	}
+	return out;
+}
+
+size_t lz4_decompress_destsize(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	size_t in, out = 0, slot = destsize_slot();
+	int ret;
+
+	for (in = 0; in + slot <= src_s && out < dest_s; in += slot) {
+		ret = LZ4_decompress_safe(src + in + sizeof(u32), dest + out,
+		                          min_t(u32, get_unaligned_le32(src + in), slot - sizeof(u32)), int_cap(dest_s - out));
+		if (ret <= 0)
+			return 0;
+		out += ret;
+	}
+	return out;
+}
+
+/* ---------------------------------
+ * parallel zstd, pzstd-style frames
+ * --------------------------------- */
+
+/* The input is cut into jobs of job_size, every job becomes an independent
+ * zstd frame. Worker w handles the jobs w, w + workers, ... with its own
+ * contexts. Compressed jobs go into slots of ZSTD_compressBound(job_size)
+ * in dest and are moved together afterwards, giving a valid multi-frame
+ * output. Decompression finds the frame boundaries first and then
+ * decompresses the frames in parallel the same way. */
+struct zstd_mt_worker {
+	struct work_struct work;
+	struct zstd_mt *mt;
+	int index;
+	void *cworkmem, *dworkmem;
+	ZSTD_CCtx *cctx;
+	ZSTD_DCtx *dctx;
+};
+
+struct zstd_mt {
+	struct workqueue_struct *wq;
+	int workers;
+	struct zstd_mt_worker *worker;
+	ZSTD_parameters param;
+	size_t job_size, workspace, cworkmem_size, dworkmem_size;
+	/* the current run, bound is the slot size for one job */
+	bool decompress, failed;
+	void *dest, *src;
+	size_t dest_s, src_s, jobs, bound;
+	size_t *offsets, *sizes;
+};
+
+static void zstd_mt_work(struct work_struct *work) {
+	struct zstd_mt_worker *w = container_of(work, struct zstd_mt_worker, work);
+	struct zstd_mt *mt = w->mt;
+	size_t j, ret;
+
+	for (j = w->index; j < mt->jobs && !READ_ONCE(mt->failed); j += mt->workers) {
+		if (mt->decompress)
+			ret = ZSTD_decompressDCtx(w->dctx, mt->dest + j * mt->job_size,
+			                          min(mt->job_size, mt->dest_s - j * mt->job_size),
+			                          mt->src + mt->offsets[j], mt->sizes[j]);
+		else
+			ret = ZSTD_compressCCtx(w->cctx, mt->dest + j * mt->bound, mt->bound,
+			                        mt->src + j * mt->job_size,
+			                        min(mt->job_size, mt->src_s - j * mt->job_size), mt->param);
+		if (ZSTD_isError(ret)) {
+			WRITE_ONCE(mt->failed, true);
+			return;
+		}
+		mt->sizes[j] = ret;
+	}
+}
+
+/* start all workers on the current run and wait for them */
+static int zstd_mt_run(struct zstd_mt *mt) {
+	int i;
+	mt->failed = false;
+	for (i = 0; i < mt->workers; i++)
+		queue_work(mt->wq, &mt->worker[i].work);
+	for (i = 0; i < mt->workers; i++)
+		flush_work(&mt->worker[i].work);
+	return mt->failed;
+}
+
+size_t _zstd_mt_compress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level) {
+	struct zstd_mt *mt = ctx->zstd_mt;
+	size_t j, compressed_size = 0;
+
+	mt->jobs = DIV_ROUND_UP(src_s, mt->job_size);
+	mt->bound = ZSTD_compressBound(min_t(size_t, mt->job_size, src_s));
+	if (mt->jobs * mt->bound > dest_s)
+		return 0;
+	if (!(mt->sizes = account_kmalloc(mt->jobs * sizeof(size_t), GFP_KERNEL)))
+		return 0;
+	mt->decompress = false;
+	mt->dest = dest;
+	mt->src = src;
+	mt->dest_s = dest_s;
+	mt->src_s = src_s;
+
+	if (!zstd_mt_run(mt))
+		/* concatenate the frames */
+		for (j = 0; j < mt->jobs; j++) {
+			memmove(dest + compressed_size, dest + j * mt->bound, mt->sizes[j]);
+			compressed_size += mt->sizes[j];
+		}
+
+	account_kfree(mt->sizes);
+	mt->sizes = NULL;
+	return compressed_size;
+}
+
+size_t _zstd_mt_decompress(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s) {
+	struct zstd_mt *mt = ctx->zstd_mt;
+	size_t size, offset = 0, max_jobs = DIV_ROUND_UP(dest_s, mt->job_size), ret = 0;
+
+	if (!(mt->sizes = account_kmalloc(max_jobs * sizeof(size_t), GFP_KERNEL)))
+		return 0;
+	if (!(mt->offsets = account_kmalloc(max_jobs * sizeof(size_t), GFP_KERNEL)))
+		goto EXIT;
+
+	/* find frame boundaries */
+	for (mt->jobs = 0; offset < src_s; mt->jobs++) {
+		size = ZSTD_findFrameCompressedSize(src + offset, src_s - offset);
+		if (ZSTD_isError(size) || mt->jobs == max_jobs)
+			goto EXIT;
+		mt->offsets[mt->jobs] = offset;
+		mt->sizes[mt->jobs] = size;
+		offset += size;
+	}
+	mt->decompress = true;
+	mt->dest = dest;
+	mt->src = src;
+	mt->dest_s = dest_s;
+	mt->src_s = src_s;
+
+	if (!zstd_mt_run(mt))
+		ret = dest_s;
+
+EXIT:
+	account_kfree(mt->offsets);
+	account_kfree(mt->sizes);
+	mt->offsets = mt->sizes = NULL;
+	return ret;
+}
+
+static void zstd_mt_free(struct zstd_mt *mt) {
+	int i;
+	if (!mt) return;
+	if (mt->wq) destroy_workqueue(mt->wq);
+	if (mt->worker)
+		for (i = 0; i < mt->workers; i++) {
+			account_vfree(mt->worker[i].cworkmem, mt->cworkmem_size);
+			account_vfree(mt->worker[i].dworkmem, mt->dworkmem_size);
+		}
+	account_kfree(mt->worker);
+	account_kfree(mt);
+}
+
+/* one worker per online cpu, jobs are 4 windows large like in pzstd */
+static struct zstd_mt *zstd_mt_init(int level, size_t size) {
+	struct zstd_mt *mt;
+	struct zstd_mt_worker *w;
+	int i;
+
+	if (!(mt = account_kzalloc(sizeof(*mt), GFP_KERNEL)))
+		return NULL;
+	mt->workers = num_online_cpus();
+	mt->job_size = (size_t)4 << ZSTD_getCParams(level, 0, 0).windowLog;
+	mt->param = ZSTD_getParams(level, min(mt->job_size, size), 0);
+	mt->cworkmem_size = ZSTD_CCtxWorkspaceBound(mt->param.cParams);
+	mt->dworkmem_size = ZSTD_DCtxWorkspaceBound();
+	mt->workspace = mt->workers * (mt->cworkmem_size + mt->dworkmem_size);
+
+	if (!(mt->wq = alloc_workqueue("compbm_zstd_mt", WQ_UNBOUND, mt->workers)))
+		goto ERR;
+	if (!(mt->worker = account_kzalloc(mt->workers * sizeof(*mt->worker), GFP_KERNEL)))
+		goto ERR;
+	for (i = 0; i < mt->workers; i++) {
+		w = &mt->worker[i];
+		w->mt = mt;
+		w->index = i;
+		INIT_WORK(&w->work, zstd_mt_work);
+		if (!(w->cworkmem = account_vmalloc(mt->cworkmem_size)))
+			goto ERR;
+		if (!(w->cctx = ZSTD_initCCtx(w->cworkmem, mt->cworkmem_size)))
+			goto ERR;
+		if (!(w->dworkmem = account_vmalloc(mt->dworkmem_size)))
+			goto ERR;
+		if (!(w->dctx = ZSTD_initDCtx(w->dworkmem, mt->dworkmem_size)))
+			goto ERR;
+	}
+	return mt;
+
+ERR:
+	zstd_mt_free(mt);
+	return NULL;
+}
+
+/* -------------
+ * output bounds
+ * ------------- */
+
+/* lz4 blocks grow by at most 1/255 and 16 bytes. Streams compress every
+ * piece of the buffer as a block of its own, so they add 16 per piece */
+static size_t lz4_pieces_bound(size_t size, size_t pieces) {
+	return size + size / 255 + 16 * pieces;
+}
+/* codecs going through chunked_compress */
+static size_t chunked_bound(size_t size, size_t (*chunk_bound)(size_t)) {
+	size_t full = size / COMPRESS_CHUNK, rest = size % COMPRESS_CHUNK;
+	if (size <= COMPRESS_CHUNK)
+		return chunk_bound(size);
+	return full * (sizeof(u32) + chunk_bound(COMPRESS_CHUNK)) + (rest ? sizeof(u32) + chunk_bound(rest) : 0);
+}
+static size_t lz4_chunk_bound(size_t size) {
+	return LZ4_compressBound(size);
+}
+static size_t zfs_zstd_chunk_bound(size_t size) {
+	return ZSTD_compressBound(size) + sizeof(zfs_zstdhdr_t);
+}
+
+size_t _memcpy_bound(union buffer *buffer, size_t size, int level) {
+	return size;
+}
+size_t _lz4_bound(union buffer *buffer, size_t size, int level) {
+	return chunked_bound(size, lz4_chunk_bound);
+}
+size_t _zfs_zstd_bound(union buffer *buffer, size_t size, int level) {
+	return chunked_bound(size, zfs_zstd_chunk_bound);
+}
+size_t _zstd_bound(union buffer *buffer, size_t size, int level) {
+	return ZSTD_compressBound(size);
+}
+/* a slot of ZSTD_compressBound(job_size) per job, as _zstd_mt_compress checks */
+size_t _zstd_mt_bound(union buffer *buffer, size_t size, int level) {
+	size_t job_size = (size_t)4 << ZSTD_getCParams(level, 0, 0).windowLog;
+	return DIV_ROUND_UP(size, job_size) * ZSTD_compressBound(min(job_size, size));
+}
+size_t blocks_lz4_bound(union buffer *buffer, size_t size, int level) {
+	return lz4_pieces_bound(size, buffer->block_array.bs);
+}
+/* the lz4 page streams compress whole pages, the tail of the last one too */
+size_t pages_lz4_bound(union buffer *buffer, size_t size, int level) {
+	return lz4_pieces_bound(buffer->page_array.ps * PAGE_SIZE, buffer->page_array.ps);
+}
+size_t sg_lz4_bound(union buffer *buffer, size_t size, int level) {
+	return lz4_pieces_bound(size, buffer->sg_list.nents);
+}
+/* every bvec is cut at the page boundaries it crosses */
+size_t bvec_lz4_bound(union buffer *buffer, size_t size, int level) {
+	return lz4_pieces_bound(size, DIV_ROUND_UP(size, PAGE_SIZE) + buffer->bvec_array.nr);
+}
+#ifdef COMPBM_ABD
+/* abd_iterate_func maps scatter abds page by page */
+size_t abd_lz4_bound(union buffer *buffer, size_t size, int level) {
+	return lz4_pieces_bound(size, DIV_ROUND_UP(size, PAGE_SIZE) + 1);
+}
+#endif
+/* every slot takes at least what fits into it at lz4's worst case */
+size_t lz4_destsize_bound(union buffer *buffer, size_t size, int level) {
+	size_t room = destsize_slot() - sizeof(u32) - 16;
+	return DIV_ROUND_UP(size, room - DIV_ROUND_UP(room, 256)) * destsize_slot();
+}
+
 struct compress_api compress_list[] = {
 // list_start
-	{POINTER, "dummy", _memcpy_compress, _memcpy_decompress, 0},
-	{POINTER, "lz4_0", _lz4_compress, _lz4_decompress, 1},
-	{POINTER, "lz4_1", _lz4_compress, _lz4_decompress, 1},
-	{POINTER, "lz4_2", _lz4_compress, _lz4_decompress, 2},
-	{POINTER, "lz4_3", _lz4_compress, _lz4_decompress, 3},
-	{POINTER, "lz4_4", _lz4_compress, _lz4_decompress, 4},
-	{POINTER, "lz4_5", _lz4_compress, _lz4_decompress, 5},
-	{POINTER, "lz4_6", _lz4_compress, _lz4_decompress, 6},
-	{POINTER, "lz4_7", _lz4_compress, _lz4_decompress, 7},
-	{POINTER, "lz4_8", _lz4_compress, _lz4_decompress, 8},
-	{POINTER, "lz4_9", _lz4_compress, _lz4_decompress, 9},
-	{POINTER, "zfs_zstd_0", _zfs_zstd_compress, _zfs_zstd_decompress, 1},
-	{POINTER, "zfs_zstd_1", _zfs_zstd_compress, _zfs_zstd_decompress, 1},
-	{POINTER, "zfs_zstd_2", _zfs_zstd_compress, _zfs_zstd_decompress, 2},
-	{POINTER, "zfs_zstd_3", _zfs_zstd_compress, _zfs_zstd_decompress, 3},
-	{POINTER, "zfs_zstd_4", _zfs_zstd_compress, _zfs_zstd_decompress, 4},
-	{POINTER, "zfs_zstd_5", _zfs_zstd_compress, _zfs_zstd_decompress, 5},
-	{POINTER, "zfs_zstd_6", _zfs_zstd_compress, _zfs_zstd_decompress, 6},
-	{POINTER, "zfs_zstd_7", _zfs_zstd_compress, _zfs_zstd_decompress, 7},
-	{POINTER, "zfs_zstd_8", _zfs_zstd_compress, _zfs_zstd_decompress, 8},
-	{POINTER, "zfs_zstd_9", _zfs_zstd_compress, _zfs_zstd_decompress, 9},
-	{POINTER, "zstd_0", _zstd_compress, _zstd_decompress, 1},
-	{POINTER, "zstd_1", _zstd_compress, _zstd_decompress, 1},
-	{POINTER, "zstd_2", _zstd_compress, _zstd_decompress, 2},
-	{POINTER, "zstd_3", _zstd_compress, _zstd_decompress, 3},
-	{POINTER, "zstd_4", _zstd_compress, _zstd_decompress, 4},
-	{POINTER, "zstd_5", _zstd_compress, _zstd_decompress, 5},
-	{POINTER, "zstd_6", _zstd_compress, _zstd_decompress, 6},
-	{POINTER, "zstd_7", _zstd_compress, _zstd_decompress, 7},
-	{POINTER, "zstd_8", _zstd_compress, _zstd_decompress, 8},
-	{POINTER, "zstd_9", _zstd_compress, _zstd_decompress, 9},
-	{BLOCK_ARRAY, "blocks_lz4_stream_0", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 0},
-	{BLOCK_ARRAY, "blocks_lz4_stream_1", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 1},
-	{BLOCK_ARRAY, "blocks_lz4_stream_2", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 2},
-	{BLOCK_ARRAY, "blocks_lz4_stream_3", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 3},
-	{BLOCK_ARRAY, "blocks_lz4_stream_4", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 4},
-	{BLOCK_ARRAY, "blocks_lz4_stream_5", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 5},
-	{BLOCK_ARRAY, "blocks_lz4_stream_6", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 6},
-	{BLOCK_ARRAY, "blocks_lz4_stream_7", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 7},
-	{BLOCK_ARRAY, "blocks_lz4_stream_8", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 8},
-	{BLOCK_ARRAY, "blocks_lz4_stream_9", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, 9},
-	{PAGE_ARRAY, "pages_lz4_stream_0", pages_lz4_compress_stream, pages_lz4_decompress_stream, 0},
-	{PAGE_ARRAY, "pages_lz4_stream_1", pages_lz4_compress_stream, pages_lz4_decompress_stream, 1},
-	{PAGE_ARRAY, "pages_lz4_stream_2", pages_lz4_compress_stream, pages_lz4_decompress_stream, 2},
-	{PAGE_ARRAY, "pages_lz4_stream_3", pages_lz4_compress_stream, pages_lz4_decompress_stream, 3},
-	{PAGE_ARRAY, "pages_lz4_stream_4", pages_lz4_compress_stream, pages_lz4_decompress_stream, 4},
-	{PAGE_ARRAY, "pages_lz4_stream_5", pages_lz4_compress_stream, pages_lz4_decompress_stream, 5},
-	{PAGE_ARRAY, "pages_lz4_stream_6", pages_lz4_compress_stream, pages_lz4_decompress_stream, 6},
-	{PAGE_ARRAY, "pages_lz4_stream_7", pages_lz4_compress_stream, pages_lz4_decompress_stream, 7},
-	{PAGE_ARRAY, "pages_lz4_stream_8", pages_lz4_compress_stream, pages_lz4_decompress_stream, 8},
-	{PAGE_ARRAY, "pages_lz4_stream_9", pages_lz4_compress_stream, pages_lz4_decompress_stream, 9},
+	{POINTER, "dummy", _memcpy_compress, _memcpy_decompress, _memcpy_bound, 0},
+	{POINTER, "lz4_0", _lz4_compress, _lz4_decompress, _lz4_bound, 1},
+	{POINTER, "lz4_1", _lz4_compress, _lz4_decompress, _lz4_bound, 1},
+	{POINTER, "lz4_2", _lz4_compress, _lz4_decompress, _lz4_bound, 2},
+	{POINTER, "lz4_3", _lz4_compress, _lz4_decompress, _lz4_bound, 3},
+	{POINTER, "lz4_4", _lz4_compress, _lz4_decompress, _lz4_bound, 4},
+	{POINTER, "lz4_5", _lz4_compress, _lz4_decompress, _lz4_bound, 5},
+	{POINTER, "lz4_6", _lz4_compress, _lz4_decompress, _lz4_bound, 6},
+	{POINTER, "lz4_7", _lz4_compress, _lz4_decompress, _lz4_bound, 7},
+	{POINTER, "lz4_8", _lz4_compress, _lz4_decompress, _lz4_bound, 8},
+	{POINTER, "lz4_9", _lz4_compress, _lz4_decompress, _lz4_bound, 9},
+	{POINTER, "lz4hc_1", _lz4hc_compress, _lz4_decompress, _lz4_bound, 1},
+	{POINTER, "lz4hc_2", _lz4hc_compress, _lz4_decompress, _lz4_bound, 2},
+	{POINTER, "lz4hc_3", _lz4hc_compress, _lz4_decompress, _lz4_bound, 3},
+	{POINTER, "lz4hc_4", _lz4hc_compress, _lz4_decompress, _lz4_bound, 4},
+	{POINTER, "lz4hc_5", _lz4hc_compress, _lz4_decompress, _lz4_bound, 5},
+	{POINTER, "lz4hc_6", _lz4hc_compress, _lz4_decompress, _lz4_bound, 6},
+	{POINTER, "lz4hc_7", _lz4hc_compress, _lz4_decompress, _lz4_bound, 7},
+	{POINTER, "lz4hc_8", _lz4hc_compress, _lz4_decompress, _lz4_bound, 8},
+	{POINTER, "lz4hc_9", _lz4hc_compress, _lz4_decompress, _lz4_bound, 9},
+	{POINTER, "lz4hc_10", _lz4hc_compress, _lz4_decompress, _lz4_bound, 10},
+	{POINTER, "lz4hc_11", _lz4hc_compress, _lz4_decompress, _lz4_bound, 11},
+	{POINTER, "lz4hc_12", _lz4hc_compress, _lz4_decompress, _lz4_bound, 12},
+	{POINTER, "zfs_zstd_0", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 1},
+	{POINTER, "zfs_zstd_1", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 1},
+	{POINTER, "zfs_zstd_2", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 2},
+	{POINTER, "zfs_zstd_3", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 3},
+	{POINTER, "zfs_zstd_4", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 4},
+	{POINTER, "zfs_zstd_5", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 5},
+	{POINTER, "zfs_zstd_6", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 6},
+	{POINTER, "zfs_zstd_7", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 7},
+	{POINTER, "zfs_zstd_8", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 8},
+	{POINTER, "zfs_zstd_9", _zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 9},
+	{POINTER, "zstd_0", _zstd_compress, _zstd_decompress, _zstd_bound, 1},
+	{POINTER, "zstd_1", _zstd_compress, _zstd_decompress, _zstd_bound, 1},
+	{POINTER, "zstd_2", _zstd_compress, _zstd_decompress, _zstd_bound, 2},
+	{POINTER, "zstd_3", _zstd_compress, _zstd_decompress, _zstd_bound, 3},
+	{POINTER, "zstd_4", _zstd_compress, _zstd_decompress, _zstd_bound, 4},
+	{POINTER, "zstd_5", _zstd_compress, _zstd_decompress, _zstd_bound, 5},
+	{POINTER, "zstd_6", _zstd_compress, _zstd_decompress, _zstd_bound, 6},
+	{POINTER, "zstd_7", _zstd_compress, _zstd_decompress, _zstd_bound, 7},
+	{POINTER, "zstd_8", _zstd_compress, _zstd_decompress, _zstd_bound, 8},
+	{POINTER, "zstd_9", _zstd_compress, _zstd_decompress, _zstd_bound, 9},
+	{POINTER, "zstd_10", _zstd_compress, _zstd_decompress, _zstd_bound, 10},
+	{POINTER, "zstd_11", _zstd_compress, _zstd_decompress, _zstd_bound, 11},
+	{POINTER, "zstd_12", _zstd_compress, _zstd_decompress, _zstd_bound, 12},
+	{POINTER, "zstd_13", _zstd_compress, _zstd_decompress, _zstd_bound, 13},
+	{POINTER, "zstd_14", _zstd_compress, _zstd_decompress, _zstd_bound, 14},
+	{POINTER, "zstd_15", _zstd_compress, _zstd_decompress, _zstd_bound, 15},
+	{POINTER, "zstd_16", _zstd_compress, _zstd_decompress, _zstd_bound, 16},
+	{POINTER, "zstd_17", _zstd_compress, _zstd_decompress, _zstd_bound, 17},
+	{POINTER, "zstd_18", _zstd_compress, _zstd_decompress, _zstd_bound, 18},
+	{POINTER, "zstd_19", _zstd_compress, _zstd_decompress, _zstd_bound, 19},
+	{POINTER, "zstd_20", _zstd_compress, _zstd_decompress, _zstd_bound, 20},
+	{POINTER, "zstd_21", _zstd_compress, _zstd_decompress, _zstd_bound, 21},
+	{POINTER, "zstd_22", _zstd_compress, _zstd_decompress, _zstd_bound, 22},
+	{POINTER, "zstd_mt_0", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 1},
+	{POINTER, "zstd_mt_1", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 1},
+	{POINTER, "zstd_mt_2", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 2},
+	{POINTER, "zstd_mt_3", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 3},
+	{POINTER, "zstd_mt_4", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 4},
+	{POINTER, "zstd_mt_5", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 5},
+	{POINTER, "zstd_mt_6", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 6},
+	{POINTER, "zstd_mt_7", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 7},
+	{POINTER, "zstd_mt_8", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 8},
+	{POINTER, "zstd_mt_9", _zstd_mt_compress, _zstd_mt_decompress, _zstd_mt_bound, 9},
+	{BLOCK_ARRAY, "blocks_lz4_stream_0", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 0},
+	{BLOCK_ARRAY, "blocks_lz4_stream_1", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 1},
+	{BLOCK_ARRAY, "blocks_lz4_stream_2", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 2},
+	{BLOCK_ARRAY, "blocks_lz4_stream_3", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 3},
+	{BLOCK_ARRAY, "blocks_lz4_stream_4", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 4},
+	{BLOCK_ARRAY, "blocks_lz4_stream_5", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 5},
+	{BLOCK_ARRAY, "blocks_lz4_stream_6", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 6},
+	{BLOCK_ARRAY, "blocks_lz4_stream_7", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 7},
+	{BLOCK_ARRAY, "blocks_lz4_stream_8", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 8},
+	{BLOCK_ARRAY, "blocks_lz4_stream_9", blocks_lz4_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 9},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_1", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 1},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_2", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 2},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_3", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 3},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_4", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 4},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_5", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 5},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_6", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 6},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_7", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 7},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_8", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 8},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_9", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 9},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_10", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 10},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_11", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 11},
+	{BLOCK_ARRAY, "blocks_lz4hc_stream_12", blocks_lz4hc_compress_stream, blocks_lz4_decompress_stream, blocks_lz4_bound, 12},
+	{PAGE_ARRAY, "pages_lz4_stream_0", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 0},
+	{PAGE_ARRAY, "pages_lz4_stream_1", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 1},
+	{PAGE_ARRAY, "pages_lz4_stream_2", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 2},
+	{PAGE_ARRAY, "pages_lz4_stream_3", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 3},
+	{PAGE_ARRAY, "pages_lz4_stream_4", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 4},
+	{PAGE_ARRAY, "pages_lz4_stream_5", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 5},
+	{PAGE_ARRAY, "pages_lz4_stream_6", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 6},
+	{PAGE_ARRAY, "pages_lz4_stream_7", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 7},
+	{PAGE_ARRAY, "pages_lz4_stream_8", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 8},
+	{PAGE_ARRAY, "pages_lz4_stream_9", pages_lz4_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 9},
+	{PAGE_ARRAY, "pages_lz4hc_stream_1", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 1},
+	{PAGE_ARRAY, "pages_lz4hc_stream_2", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 2},
+	{PAGE_ARRAY, "pages_lz4hc_stream_3", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 3},
+	{PAGE_ARRAY, "pages_lz4hc_stream_4", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 4},
+	{PAGE_ARRAY, "pages_lz4hc_stream_5", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 5},
+	{PAGE_ARRAY, "pages_lz4hc_stream_6", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 6},
+	{PAGE_ARRAY, "pages_lz4hc_stream_7", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 7},
+	{PAGE_ARRAY, "pages_lz4hc_stream_8", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 8},
+	{PAGE_ARRAY, "pages_lz4hc_stream_9", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 9},
+	{PAGE_ARRAY, "pages_lz4hc_stream_10", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 10},
+	{PAGE_ARRAY, "pages_lz4hc_stream_11", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 11},
+	{PAGE_ARRAY, "pages_lz4hc_stream_12", pages_lz4hc_compress_stream, pages_lz4_decompress_stream, pages_lz4_bound, 12},
+	{BLOCK_ARRAY, "blocks_zstd_stream_0", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{BLOCK_ARRAY, "blocks_zstd_stream_1", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{BLOCK_ARRAY, "blocks_zstd_stream_2", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 2},
+	{BLOCK_ARRAY, "blocks_zstd_stream_3", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 3},
+	{BLOCK_ARRAY, "blocks_zstd_stream_4", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 4},
+	{BLOCK_ARRAY, "blocks_zstd_stream_5", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 5},
+	{BLOCK_ARRAY, "blocks_zstd_stream_6", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 6},
+	{BLOCK_ARRAY, "blocks_zstd_stream_7", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 7},
+	{BLOCK_ARRAY, "blocks_zstd_stream_8", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 8},
+	{BLOCK_ARRAY, "blocks_zstd_stream_9", blocks_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 9},
+	{PAGE_ARRAY, "pages_zstd_stream_0", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{PAGE_ARRAY, "pages_zstd_stream_1", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{PAGE_ARRAY, "pages_zstd_stream_2", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 2},
+	{PAGE_ARRAY, "pages_zstd_stream_3", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 3},
+	{PAGE_ARRAY, "pages_zstd_stream_4", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 4},
+	{PAGE_ARRAY, "pages_zstd_stream_5", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 5},
+	{PAGE_ARRAY, "pages_zstd_stream_6", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 6},
+	{PAGE_ARRAY, "pages_zstd_stream_7", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 7},
+	{PAGE_ARRAY, "pages_zstd_stream_8", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 8},
+	{PAGE_ARRAY, "pages_zstd_stream_9", pages_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 9},
+	{SG_LIST, "sg_lz4_stream_0", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 0},
+	{SG_LIST, "sg_lz4_stream_1", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 1},
+	{SG_LIST, "sg_lz4_stream_2", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 2},
+	{SG_LIST, "sg_lz4_stream_3", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 3},
+	{SG_LIST, "sg_lz4_stream_4", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 4},
+	{SG_LIST, "sg_lz4_stream_5", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 5},
+	{SG_LIST, "sg_lz4_stream_6", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 6},
+	{SG_LIST, "sg_lz4_stream_7", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 7},
+	{SG_LIST, "sg_lz4_stream_8", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 8},
+	{SG_LIST, "sg_lz4_stream_9", sg_lz4_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 9},
+	{SG_LIST, "sg_lz4hc_stream_1", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 1},
+	{SG_LIST, "sg_lz4hc_stream_2", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 2},
+	{SG_LIST, "sg_lz4hc_stream_3", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 3},
+	{SG_LIST, "sg_lz4hc_stream_4", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 4},
+	{SG_LIST, "sg_lz4hc_stream_5", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 5},
+	{SG_LIST, "sg_lz4hc_stream_6", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 6},
+	{SG_LIST, "sg_lz4hc_stream_7", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 7},
+	{SG_LIST, "sg_lz4hc_stream_8", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 8},
+	{SG_LIST, "sg_lz4hc_stream_9", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 9},
+	{SG_LIST, "sg_lz4hc_stream_10", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 10},
+	{SG_LIST, "sg_lz4hc_stream_11", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 11},
+	{SG_LIST, "sg_lz4hc_stream_12", sg_lz4hc_compress_stream, sg_lz4_decompress_stream, sg_lz4_bound, 12},
+	{SG_LIST, "sg_zstd_stream_0", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{SG_LIST, "sg_zstd_stream_1", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{SG_LIST, "sg_zstd_stream_2", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 2},
+	{SG_LIST, "sg_zstd_stream_3", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 3},
+	{SG_LIST, "sg_zstd_stream_4", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 4},
+	{SG_LIST, "sg_zstd_stream_5", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 5},
+	{SG_LIST, "sg_zstd_stream_6", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 6},
+	{SG_LIST, "sg_zstd_stream_7", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 7},
+	{SG_LIST, "sg_zstd_stream_8", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 8},
+	{SG_LIST, "sg_zstd_stream_9", sg_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 9},
+	{BVEC, "bvec_lz4_iter_0", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 0},
+	{BVEC, "bvec_lz4_iter_1", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 1},
+	{BVEC, "bvec_lz4_iter_2", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 2},
+	{BVEC, "bvec_lz4_iter_3", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 3},
+	{BVEC, "bvec_lz4_iter_4", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 4},
+	{BVEC, "bvec_lz4_iter_5", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 5},
+	{BVEC, "bvec_lz4_iter_6", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 6},
+	{BVEC, "bvec_lz4_iter_7", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 7},
+	{BVEC, "bvec_lz4_iter_8", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 8},
+	{BVEC, "bvec_lz4_iter_9", bvec_lz4_compress_iter, bvec_lz4_decompress_iter, bvec_lz4_bound, 9},
+	{BVEC, "bvec_zstd_iter_0", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 1},
+	{BVEC, "bvec_zstd_iter_1", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 1},
+	{BVEC, "bvec_zstd_iter_2", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 2},
+	{BVEC, "bvec_zstd_iter_3", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 3},
+	{BVEC, "bvec_zstd_iter_4", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 4},
+	{BVEC, "bvec_zstd_iter_5", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 5},
+	{BVEC, "bvec_zstd_iter_6", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 6},
+	{BVEC, "bvec_zstd_iter_7", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 7},
+	{BVEC, "bvec_zstd_iter_8", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 8},
+	{BVEC, "bvec_zstd_iter_9", bvec_zstd_compress_iter, bvec_zstd_decompress_iter, _zstd_bound, 9},
+#ifdef COMPBM_ABD
+	{ABD, "abd_zfs_zstd_0", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 1},
+	{ABD, "abd_zfs_zstd_1", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 1},
+	{ABD, "abd_zfs_zstd_2", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 2},
+	{ABD, "abd_zfs_zstd_3", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 3},
+	{ABD, "abd_zfs_zstd_4", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 4},
+	{ABD, "abd_zfs_zstd_5", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 5},
+	{ABD, "abd_zfs_zstd_6", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 6},
+	{ABD, "abd_zfs_zstd_7", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 7},
+	{ABD, "abd_zfs_zstd_8", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 8},
+	{ABD, "abd_zfs_zstd_9", abd_zfs_zstd_compress, _zfs_zstd_decompress, _zfs_zstd_bound, 9},
+	{ABD, "abd_lz4_0", abd_lz4_compress, _lz4_decompress, _lz4_bound, 1},
+	{ABD, "abd_lz4_1", abd_lz4_compress, _lz4_decompress, _lz4_bound, 1},
+	{ABD, "abd_lz4_2", abd_lz4_compress, _lz4_decompress, _lz4_bound, 2},
+	{ABD, "abd_lz4_3", abd_lz4_compress, _lz4_decompress, _lz4_bound, 3},
+	{ABD, "abd_lz4_4", abd_lz4_compress, _lz4_decompress, _lz4_bound, 4},
+	{ABD, "abd_lz4_5", abd_lz4_compress, _lz4_decompress, _lz4_bound, 5},
+	{ABD, "abd_lz4_6", abd_lz4_compress, _lz4_decompress, _lz4_bound, 6},
+	{ABD, "abd_lz4_7", abd_lz4_compress, _lz4_decompress, _lz4_bound, 7},
+	{ABD, "abd_lz4_8", abd_lz4_compress, _lz4_decompress, _lz4_bound, 8},
+	{ABD, "abd_lz4_9", abd_lz4_compress, _lz4_decompress, _lz4_bound, 9},
+	{ABD, "abd_lz4_stream_0", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 0},
+	{ABD, "abd_lz4_stream_1", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 1},
+	{ABD, "abd_lz4_stream_2", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 2},
+	{ABD, "abd_lz4_stream_3", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 3},
+	{ABD, "abd_lz4_stream_4", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 4},
+	{ABD, "abd_lz4_stream_5", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 5},
+	{ABD, "abd_lz4_stream_6", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 6},
+	{ABD, "abd_lz4_stream_7", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 7},
+	{ABD, "abd_lz4_stream_8", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 8},
+	{ABD, "abd_lz4_stream_9", abd_lz4_compress_stream, abd_lz4_decompress_stream, abd_lz4_bound, 9},
+	{ABD, "abd_zstd_stream_0", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{ABD, "abd_zstd_stream_1", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 1},
+	{ABD, "abd_zstd_stream_2", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 2},
+	{ABD, "abd_zstd_stream_3", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 3},
+	{ABD, "abd_zstd_stream_4", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 4},
+	{ABD, "abd_zstd_stream_5", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 5},
+	{ABD, "abd_zstd_stream_6", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 6},
+	{ABD, "abd_zstd_stream_7", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 7},
+	{ABD, "abd_zstd_stream_8", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 8},
+	{ABD, "abd_zstd_stream_9", abd_zstd_compress_stream, _zstd_decompress_stream, _zstd_bound, 9},
+#endif
+	{POINTER, "lz4_destsize", lz4_compress_destsize, lz4_decompress_destsize, lz4_destsize_bound, 1},
 // list_end
 };
 
@@ -191,53 +1239,177 @@ int compress_choose(char *name, struct compress_api *compress_api) {
 	return i == SIZE(compress_list);
 }
 
-int compress_init(struct compress_api compress_api) {
+/* i-th entry of compress_list, used to walk the whole list */
+int compress_nth(int i, struct compress_api *compress_api) {
+	if (i < 0 || i >= SIZE(compress_list))
+		return 1;
+	*compress_api = compress_list[i];
+	return 0;
+}
+
+/* allocations of a context, counted into its workspace. kmalloc ones are zeroed */
+static void *ctx_kmalloc(struct compress_ctx *ctx, size_t size) {
+	void *p;
+	if ((p = account_kzalloc(size, GFP_KERNEL)))
+		ctx->workspace += size;
+	return p;
+}
+static void *ctx_vmalloc(struct compress_ctx *ctx, size_t size) {
+	void *p;
+	if ((p = account_vmalloc(size)))
+		ctx->workspace += size;
+	return p;
+}
+
+/* size is the input size the context is used for, zstd tables and windows
+ * are sized for it instead of for unbounded input */
+struct compress_ctx *compress_ctx_init(struct compress_api compress_api, size_t size) {
 	/* LZ4 needs an explicit workmem. zstd allocates his own on the first run,
 	 * but keeps it through runs, as the zstd module stays loaded */
+	struct compress_ctx *ctx;
+	ZSTD_compressionParameters zstd_cparam;
 	size_t cworkmem_size = 0, dworkmem_size = 0;
-	
+
+	if (!(ctx = account_kzalloc(sizeof(*ctx), GFP_KERNEL)))
+		return NULL;
+
 	/* alloc workmem */
-	if (!(lz4_stream = kmalloc(sizeof(LZ4_stream_t), GFP_KERNEL)))
-		return 1;
-	memset(lz4_stream, 0, sizeof(LZ4_stream_t));
-	
-	if (!(lz4_streamDecode = kmalloc(sizeof(LZ4_streamDecode_t), GFP_KERNEL)))
-		return 1;
-	memset(lz4_streamDecode, 0, sizeof(LZ4_streamDecode_t));
+	if (!(ctx->lz4_stream = ctx_kmalloc(ctx, sizeof(LZ4_stream_t))))
+		goto ERR;
+	if (!(ctx->lz4_streamDecode = ctx_kmalloc(ctx, sizeof(LZ4_streamDecode_t))))
+		goto ERR;
 
-	if (compress_api.compress == _lz4_compress)
-		if (!(lz4_workmem = vmalloc(LZ4_MEM_COMPRESS)))
-			return 1;
+	if (compress_api.compress == _lz4_compress ||
+#ifdef COMPBM_ABD
+	    compress_api.compress == abd_lz4_compress ||
+#endif
+	    compress_api.compress == lz4_compress_destsize)
+		if (!(ctx->lz4_workmem = ctx_vmalloc(ctx, LZ4_MEM_COMPRESS)))
+			goto ERR;
+	if (compress_api.compress == _lz4hc_compress ||
+	    compress_api.compress == blocks_lz4hc_compress_stream ||
+	    compress_api.compress == pages_lz4hc_compress_stream ||
+	    compress_api.compress == sg_lz4hc_compress_stream)
+		if (!(ctx->lz4hc_stream = ctx_vmalloc(ctx, sizeof(LZ4_streamHC_t))))
+			goto ERR;
 	if (compress_api.compress == _zstd_compress) {
-		pr_alert("foo\n");
-		zstd_cparam = ZSTD_getCParams(compress_api.level, 0 /* unknown input size */, 0 /* no dictionary */);
-		pr_alert("foo\n");
-		zstd_param = ZSTD_getParams(compress_api.level, 0 /* unknown input size */, 0 /* no dictionary */);
-		pr_alert("foo\n");
-		cworkmem_size = ZSTD_CCtxWorkspaceBound(zstd_cparam);
-		pr_alert("foo %d\n", cworkmem_size);
-		if (!(zstd_cworkmem = vmalloc(cworkmem_size)))
-			return 1;
-		pr_alert("foo\n");
-		if (!(zstd_ccontext = ZSTD_initCCtx(zstd_cworkmem, cworkmem_size)))
-			return 1;
-		pr_alert("foo\n");
+		/* ZSTD_getCParams picks the table for size and shrinks window, hash
+		 * and chain logs to it through ZSTD_adjustCParams */
+		zstd_cparam = ZSTD_getCParams(compress_api.level, size, 0 /* no dictionary */);
+		ctx->zstd_param = ZSTD_getParams(compress_api.level, size, 0 /* no dictionary */);
+		cworkmem_size = ctx->zstd_cworkmem_size = ZSTD_CCtxWorkspaceBound(zstd_cparam);
+		/* levels 20-22 use windowLog 25-27, their workspace is hundreds of MB */
+		pr_debug("zstd level %d size %zu strategy %d windowLog %u workspace %zu\n",
+		         compress_api.level, size, zstd_cparam.strategy, zstd_cparam.windowLog, cworkmem_size);
+		if (!(ctx->zstd_cworkmem = ctx_vmalloc(ctx, cworkmem_size))) {
+			pr_alert("could not allocate zstd workspace of %zu bytes\n", cworkmem_size);
+			goto ERR;
+		}
+		if (!(ctx->zstd_ccontext = ZSTD_initCCtx(ctx->zstd_cworkmem, cworkmem_size)))
+			goto ERR;
 
-		dworkmem_size = ZSTD_DCtxWorkspaceBound();
-		if (!(zstd_dworkmem = vmalloc(dworkmem_size)))
-			return 1;
-		pr_alert("foo\n");
-		if (!(zstd_dcontext = ZSTD_initDCtx(zstd_dworkmem, dworkmem_size)))
-			return 1;
-		pr_alert("foo\n");
-	}	
+		dworkmem_size = ctx->zstd_dworkmem_size = ZSTD_DCtxWorkspaceBound();
+		if (!(ctx->zstd_dworkmem = ctx_vmalloc(ctx, dworkmem_size)))
+			goto ERR;
+		if (!(ctx->zstd_dcontext = ZSTD_initDCtx(ctx->zstd_dworkmem, dworkmem_size)))
+			goto ERR;
+	}
+	if (compress_api.decompress == bvec_lz4_decompress_iter || compress_api.decompress == bvec_zstd_decompress_iter)
+		if (!(ctx->iov_ring = ctx_vmalloc(ctx, IOV_RING)))
+			goto ERR;
+	if (compress_api.compress == bvec_zstd_compress_iter ||
+	    compress_api.compress == blocks_zstd_compress_stream ||
+	    compress_api.compress == pages_zstd_compress_stream ||
+#ifdef COMPBM_ABD
+	    compress_api.compress == abd_zstd_compress_stream ||
+#endif
+	    compress_api.compress == sg_zstd_compress_stream) {
+		zstd_cparam = ZSTD_getCParams(compress_api.level, size, 0 /* no dictionary */);
+		ctx->zstd_param = ZSTD_getParams(compress_api.level, size, 0 /* no dictionary */);
+		cworkmem_size = ctx->zstd_csworkmem_size = ZSTD_CStreamWorkspaceBound(zstd_cparam);
+		if (!(ctx->zstd_csworkmem = ctx_vmalloc(ctx, cworkmem_size)))
+			goto ERR;
+		if (!(ctx->zstd_cstream = ZSTD_initCStream(ctx->zstd_param, size, ctx->zstd_csworkmem, cworkmem_size)))
+			goto ERR;
+	}
+	if (compress_api.decompress == _zstd_decompress_stream || compress_api.decompress == bvec_zstd_decompress_iter) {
+		dworkmem_size = ctx->zstd_dsworkmem_size = ZSTD_DStreamWorkspaceBound((size_t)1 << zstd_cparam.windowLog);
+		if (!(ctx->zstd_dsworkmem = ctx_vmalloc(ctx, dworkmem_size)))
+			goto ERR;
+		if (!(ctx->zstd_dstream = ZSTD_initDStream((size_t)1 << zstd_cparam.windowLog, ctx->zstd_dsworkmem, dworkmem_size)))
+			goto ERR;
+	}
+	if (compress_api.compress == _zstd_mt_compress) {
+		if (!(ctx->zstd_mt = zstd_mt_init(compress_api.level, size)))
+			goto ERR;
+		ctx->workspace += ctx->zstd_mt->workspace;
+	}
+	return ctx;
+
+ERR:
+	compress_ctx_free(ctx);
+	return NULL;
+}
+
+size_t compress_ctx_workspace(struct compress_ctx *ctx) {
+	return ctx ? ctx->workspace : 0;
+}
+
+void compress_ctx_free(struct compress_ctx *ctx) {
+	if (!ctx) return;
+	account_vfree(ctx->lz4_workmem, LZ4_MEM_COMPRESS);
+	account_vfree(ctx->zstd_cworkmem, ctx->zstd_cworkmem_size);
+	account_vfree(ctx->zstd_dworkmem, ctx->zstd_dworkmem_size);
+	account_vfree(ctx->zstd_dsworkmem, ctx->zstd_dsworkmem_size);
+	account_vfree(ctx->zstd_csworkmem, ctx->zstd_csworkmem_size);
+	account_vfree(ctx->iov_ring, IOV_RING);
+	account_kfree(ctx->lz4_stream);
+	account_kfree(ctx->lz4_streamDecode);
+	account_vfree(ctx->lz4hc_stream, sizeof(LZ4_streamHC_t));
+	zstd_mt_free(ctx->zstd_mt);
+	account_kfree(ctx);
+}
+
+/* set up an empty pool for compress_api, contexts are built on first use */
+int compress_init(struct compress_api compress_api, size_t size) {
+	if (!(compress_pool = alloc_percpu(struct compress_ctx *)))
+		return 1;
+	compress_pool_api = compress_api;
+	compress_pool_size = size;
 	return 0;
 }
 
+/* get a context for the current cpu, init_ns is the time spent building it
+ * on a miss and 0 for a cached one */
+struct compress_ctx *compress_get(u64 *init_ns) {
+	struct compress_ctx *ctx;
+	u64 t;
+
+	*init_ns = 0;
+	if (!compress_pool)
+		return NULL;
+	if ((ctx = this_cpu_xchg(*compress_pool, NULL)))
+		return ctx;
+	t = stats_now();
+	ctx = compress_ctx_init(compress_pool_api, compress_pool_size);
+	*init_ns = stats_now() - t;
+	return ctx;
+}
+
+/* cache ctx on the current cpu, or free it if that one has a context already */
+void compress_put(struct compress_ctx *ctx) {
+	if (!ctx) return;
+	if (!compress_pool || this_cpu_cmpxchg(*compress_pool, NULL, ctx))
+		compress_ctx_free(ctx);
+}
+
+/* reset everything, so compress_init can be called again for the next codec */
 void compress_free(void) {
-	if (lz4_workmem) vfree(lz4_workmem);
-	if (zstd_cworkmem) vfree(zstd_cworkmem);
-	if (zstd_dworkmem) vfree(zstd_dworkmem);
-	if (lz4_stream) kfree(lz4_stream);
-	if (lz4_streamDecode) kfree(lz4_streamDecode);
+	int cpu;
+
+	if (!compress_pool) return;
+	for_each_possible_cpu(cpu)
+		compress_ctx_free(*per_cpu_ptr(compress_pool, cpu));
+	free_percpu(compress_pool);
+	compress_pool = NULL;
 }
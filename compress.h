@@ -5,20 +5,36 @@
 
 /* de/compression api */
 
-typedef int (*compress_cc)(union buffer *buffer, void *dest, int dest_s, void *src, int src_s, int level);
-typedef int (*compress_dc)(union buffer *buffer, void *dest, int dest_s, void *src, int src_s);
+/* codec working state, opaque outside of compress.c */
+struct compress_ctx;
+
+typedef size_t (*compress_cc)(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s, int level);
+typedef size_t (*compress_dc)(struct compress_ctx *ctx, union buffer *buffer, void *dest, size_t dest_s, void *src, size_t src_s);
+/* worst case output for size bytes in buffer, enough for any input */
+typedef size_t (*compress_bd)(union buffer *buffer, size_t size, int level);
 
 struct compress_api {
 	enum mem_format type;
 	char *name;
 	compress_cc compress;
 	compress_dc decompress;
+	compress_bd bound;
 	int level;
 };
 
-int compress_init(struct compress_api api);
+/* slot size of the lz4_destsize codec, set at runtime */
+#define COMPRESS_DEST_MIN 64
+extern size_t compress_dest_size;
+
+struct compress_ctx *compress_ctx_init(struct compress_api compress_api, size_t size);
+void compress_ctx_free(struct compress_ctx *ctx);
+size_t compress_ctx_workspace(struct compress_ctx *ctx);
+int compress_init(struct compress_api api, size_t size);
+struct compress_ctx *compress_get(u64 *init_ns);
+void compress_put(struct compress_ctx *ctx);
 void compress_free(void);
 int compress_choose(char *name, struct compress_api *compress_api);
+int compress_nth(int i, struct compress_api *compress_api);
 
 #endif // compress_h_INCLUDED
 
@@ -0,0 +1,254 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+
+#include "mod.h"
+#include "control.h"
+#include "threads.h"
+#include "stream.h"
+
+/* every attribute works on the shared compbm state, so all accesses are
+ * serialized. Runs happen synchronously in the context of the writer. */
+static struct kobject *control_kobj;
+static DEFINE_MUTEX(control_lock);
+
+/* input: path of the loaded file and its size, write a path to load it */
+static ssize_t input_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+	ssize_t ret;
+	mutex_lock(&control_lock);
+	ret = sprintf(buf, "%s %zu\n", compbm.input ? compbm.path : "-", compbm.input_size);
+	mutex_unlock(&control_lock);
+	return ret;
+}
+static ssize_t input_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	char *copy;
+	int err;
+	if (!(copy = kmalloc(count + 1, GFP_KERNEL)))
+		return -ENOMEM;
+	memcpy(copy, buf, count);
+	copy[count] = 0;
+	mutex_lock(&control_lock);
+	err = compbm_load(strim(copy));
+	mutex_unlock(&control_lock);
+	kfree(copy);
+	return err ? -EINVAL : count;
+}
+
+/* format, transformation, compression: current names, write a name to select it */
+#define control_name_attr(field, api, format_arg, transformation_arg, compression_arg) \
+static ssize_t field ## _show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) { \
+	ssize_t ret; \
+	mutex_lock(&control_lock); \
+	ret = sprintf(buf, "%s\n", compbm.api.name ? compbm.api.name : "-"); \
+	mutex_unlock(&control_lock); \
+	return ret; \
+} \
+static ssize_t field ## _store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) { \
+	char name[64]; \
+	int err; \
+	if (count >= sizeof(name)) \
+		return -EINVAL; \
+	memcpy(name, buf, count); \
+	name[count] = 0; \
+	strim(name); \
+	mutex_lock(&control_lock); \
+	err = compbm_select(format_arg, transformation_arg, compression_arg); \
+	mutex_unlock(&control_lock); \
+	return err ? -EINVAL : count; \
+}
+control_name_attr(format, mem, name, NULL, NULL)
+control_name_attr(transformation, transform, NULL, name, NULL)
+control_name_attr(compression, compress, NULL, NULL, name)
+
+/* level: level of the selected codec, a new one drops the warm contexts */
+static ssize_t level_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+	ssize_t ret;
+	mutex_lock(&control_lock);
+	ret = sprintf(buf, "%d\n", compbm.compress.level);
+	mutex_unlock(&control_lock);
+	return ret;
+}
+static ssize_t level_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	int level;
+	if (kstrtoint(buf, 10, &level))
+		return -EINVAL;
+	mutex_lock(&control_lock);
+	if (level != compbm.compress.level) {
+		compbm_drop_contexts();
+		compbm.compress.level = level;
+	}
+	mutex_unlock(&control_lock);
+	return count;
+}
+
+/* block_size: blocks of vblocks and kblocks, used from the next run on */
+static ssize_t block_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+	ssize_t ret;
+	mutex_lock(&control_lock);
+	ret = sprintf(buf, "%zu\n", mem_block_size);
+	mutex_unlock(&control_lock);
+	return ret;
+}
+static ssize_t block_size_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	unsigned long block_size;
+	if (kstrtoul(buf, 0, &block_size) || block_size < MEM_BLOCK_MIN)
+		return -EINVAL;
+	mutex_lock(&control_lock);
+	mem_block_size = block_size;
+	mutex_unlock(&control_lock);
+	return count;
+}
+
+/* dest_size: output slots of lz4_destsize, used from the next run on */
+static ssize_t dest_size_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+	ssize_t ret;
+	mutex_lock(&control_lock);
+	ret = sprintf(buf, "%zu\n", compress_dest_size);
+	mutex_unlock(&control_lock);
+	return ret;
+}
+static ssize_t dest_size_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	unsigned long dest_size;
+	if (kstrtoul(buf, 0, &dest_size) || dest_size < COMPRESS_DEST_MIN)
+		return -EINVAL;
+	mutex_lock(&control_lock);
+	compress_dest_size = dest_size;
+	mutex_unlock(&control_lock);
+	return count;
+}
+
+/* iterations, warmup: runs per phase */
+#define control_int_attr(field, minimum) \
+static ssize_t field ## _show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) { \
+	ssize_t ret; \
+	mutex_lock(&control_lock); \
+	ret = sprintf(buf, "%d\n", compbm.field); \
+	mutex_unlock(&control_lock); \
+	return ret; \
+} \
+static ssize_t field ## _store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) { \
+	int value; \
+	if (kstrtoint(buf, 10, &value) || value < minimum) \
+		return -EINVAL; \
+	mutex_lock(&control_lock); \
+	compbm.field = value; \
+	mutex_unlock(&control_lock); \
+	return count; \
+}
+control_int_attr(iterations, 1)
+control_int_attr(warmup, 0)
+control_int_attr(thread_slice, 0)
+control_int_attr(stream_chunk, 4096)
+control_int_attr(stream_ring, 1)
+control_int_attr(stream_direct, 0)
+
+/* run, run_matrix: any write starts the benchmark and returns when it is done */
+static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	int err;
+	mutex_lock(&control_lock);
+	err = compbm_run();
+	mutex_unlock(&control_lock);
+	return err ? -EINVAL : count;
+}
+static ssize_t run_matrix_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	int err;
+	mutex_lock(&control_lock);
+	err = compbm_run_matrix();
+	mutex_unlock(&control_lock);
+	return err ? -EINVAL : count;
+}
+
+/* run_threads: write a cpu list, scales from 1 to all of its cpus */
+static ssize_t run_threads_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	char cpulist[256];
+	int err;
+	if (count >= sizeof(cpulist))
+		return -EINVAL;
+	memcpy(cpulist, buf, count);
+	cpulist[count] = 0;
+	mutex_lock(&control_lock);
+	err = threads_run(strim(cpulist));
+	mutex_unlock(&control_lock);
+	return err ? -EINVAL : count;
+}
+
+/* run_stream: write a path, it is read and compressed chunk by chunk */
+static ssize_t run_stream_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	char *copy;
+	int err;
+	if (!(copy = kmalloc(count + 1, GFP_KERNEL)))
+		return -ENOMEM;
+	memcpy(copy, buf, count);
+	copy[count] = 0;
+	mutex_lock(&control_lock);
+	err = stream_run(strim(copy));
+	mutex_unlock(&control_lock);
+	kfree(copy);
+	return err ? -EINVAL : count;
+}
+
+static struct kobj_attribute input_attr = __ATTR(input, 0644, input_show, input_store);
+static struct kobj_attribute format_attr = __ATTR(format, 0644, format_show, format_store);
+static struct kobj_attribute transformation_attr = __ATTR(transformation, 0644, transformation_show, transformation_store);
+static struct kobj_attribute compression_attr = __ATTR(compression, 0644, compression_show, compression_store);
+static struct kobj_attribute level_attr = __ATTR(level, 0644, level_show, level_store);
+static struct kobj_attribute block_size_attr = __ATTR(block_size, 0644, block_size_show, block_size_store);
+static struct kobj_attribute dest_size_attr = __ATTR(dest_size, 0644, dest_size_show, dest_size_store);
+static struct kobj_attribute iterations_attr = __ATTR(iterations, 0644, iterations_show, iterations_store);
+static struct kobj_attribute warmup_attr = __ATTR(warmup, 0644, warmup_show, warmup_store);
+static struct kobj_attribute run_attr = __ATTR(run, 0200, NULL, run_store);
+static struct kobj_attribute run_matrix_attr = __ATTR(run_matrix, 0200, NULL, run_matrix_store);
+static struct kobj_attribute thread_slice_attr = __ATTR(thread_slice, 0644, thread_slice_show, thread_slice_store);
+static struct kobj_attribute run_threads_attr = __ATTR(run_threads, 0200, NULL, run_threads_store);
+static struct kobj_attribute stream_chunk_attr = __ATTR(stream_chunk, 0644, stream_chunk_show, stream_chunk_store);
+static struct kobj_attribute stream_ring_attr = __ATTR(stream_ring, 0644, stream_ring_show, stream_ring_store);
+static struct kobj_attribute stream_direct_attr = __ATTR(stream_direct, 0644, stream_direct_show, stream_direct_store);
+static struct kobj_attribute run_stream_attr = __ATTR(run_stream, 0200, NULL, run_stream_store);
+
+static struct attribute *control_attrs[] = {
+	&input_attr.attr,
+	&format_attr.attr,
+	&transformation_attr.attr,
+	&compression_attr.attr,
+	&level_attr.attr,
+	&block_size_attr.attr,
+	&dest_size_attr.attr,
+	&iterations_attr.attr,
+	&warmup_attr.attr,
+	&run_attr.attr,
+	&run_matrix_attr.attr,
+	&thread_slice_attr.attr,
+	&run_threads_attr.attr,
+	&stream_chunk_attr.attr,
+	&stream_ring_attr.attr,
+	&stream_direct_attr.attr,
+	&run_stream_attr.attr,
+	NULL,
+};
+
+static struct attribute_group control_group = {
+	.attrs = control_attrs,
+};
+
+int control_init(void) {
+	int err;
+	if (!(control_kobj = kobject_create_and_add(KBUILD_MODNAME, kernel_kobj)))
+		return -ENOMEM;
+	if ((err = sysfs_create_group(control_kobj, &control_group))) {
+		kobject_put(control_kobj);
+		control_kobj = NULL;
+		return err;
+	}
+	return 0;
+}
+
+void control_free(void) {
+	if (control_kobj) kobject_put(control_kobj);
+	control_kobj = NULL;
+}
@@ -0,0 +1,8 @@
+#ifndef control_h_INCLUDED
+#define control_h_INCLUDED
+
+/* sysfs control interface in /sys/kernel/compbm */
+int control_init(void);
+void control_free(void);
+
+#endif // control_h_INCLUDED
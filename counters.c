@@ -0,0 +1,88 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+
+#include "counters.h"
+
+static bool counters_enabled = true;
+module_param_named(counters, counters_enabled, bool, 0000);
+MODULE_PARM_DESC(counters, "Count cpu events per phase with perf");
+
+char *counter_names[] = { "cycles", "instructions", "llc_misses", "dtlb_misses", "branch_misses" };
+
+#define DTLB_READ_MISS (PERF_COUNT_HW_CACHE_DTLB | \
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/* hardware event for every counter */
+static struct {
+	u32 type;
+	u64 config;
+} counter_events[] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{PERF_TYPE_HW_CACHE, DTLB_READ_MISS},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static struct perf_event *counter_create(u32 type, u64 config) {
+	struct perf_event_attr attr = {
+		.type = type,
+		.config = config,
+		.size = sizeof(attr),
+		.pinned = 1,
+	};
+	struct perf_event *event;
+
+	/* follow the current task, test() is not bound to a cpu */
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+/* missing counters, like in most VMs, stay NULL and read as 0. They are
+ * reported as unavailable, software events count nothing comparable */
+void counters_init(struct counters *counters) {
+	int i;
+
+	memset(counters, 0, sizeof(*counters));
+	if (!counters_enabled)
+		return;
+	for (i = 0; i < COUNTERS; i++) {
+		if ((counters->event[i] = counter_create(counter_events[i].type, counter_events[i].config)))
+			counters->events[i] = counter_names[i];
+		else
+			pr_alert("no %s counter\n", counter_names[i]);
+	}
+}
+
+void counters_free(struct counters *counters) {
+	int i;
+	for (i = 0; i < COUNTERS; i++)
+		if (counters->event[i])
+			perf_event_release_kernel(counters->event[i]);
+	memset(counters->event, 0, sizeof(counters->event));
+}
+
+static u64 counter_read(struct perf_event *event) {
+	u64 enabled, running;
+	return event ? perf_event_read_value(event, &enabled, &running) : 0;
+}
+
+void counters_start(struct counters *counters) {
+	int i;
+	for (i = 0; i < COUNTERS; i++)
+		counters->start[i] = counter_read(counters->event[i]);
+}
+
+/* add everything since counters_start to phase */
+void counters_stop(struct counters *counters, enum phase phase) {
+	int i;
+	for (i = 0; i < COUNTERS; i++)
+		counters->values[phase][i] += counter_read(counters->event[i]) - counters->start[i];
+}
@@ -0,0 +1,25 @@
+#ifndef counters_h_INCLUDED
+#define counters_h_INCLUDED
+
+#include <linux/types.h>
+#include "stats.h"
+
+/* hardware events counted per phase */
+enum counter { CYCLES, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, COUNTERS };
+extern char *counter_names[];
+
+/* counters of the running task. events names the counted event, NULL
+ * where the hardware event is not available */
+struct counters {
+	struct perf_event *event[COUNTERS];
+	char *events[COUNTERS];
+	u64 start[COUNTERS];
+	u64 values[PHASES][COUNTERS];
+};
+
+void counters_init(struct counters *counters);
+void counters_free(struct counters *counters);
+void counters_start(struct counters *counters);
+void counters_stop(struct counters *counters, enum phase phase);
+
+#endif // counters_h_INCLUDED
@@ -6,6 +6,7 @@ BEGIN {
 }
 /list_start/,/list_end/{
   if (!$3) next;
+  if ($2 == "ABD" && !ENVIRON["COMPBM_ABD"]) next;
   if (f==1)mem[$3] = $2;
   if (f==2)transform[$3] = $2;
   if (f==3)compress[$3] = $2;
@@ -1,9 +1,30 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/atomic.h>
 #include <linux/slab.h>
 #include <linux/kernel.h>
+#include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/mempool.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
+#include <linux/bvec.h>
+#include <linux/random.h>
+#include <linux/scatterlist.h>
+#include <linux/sched.h>
 #include <linux/smp.h>
+#include <linux/uio.h>
+#include <linux/version.h>
 #include <linux/vmalloc.h>
+#ifdef COMPBM_ABD
+#include "zfs/include/sys/abd.h"
+#include "zfs/include/sys/fs/zfs.h"
+#endif
+
 #include "mem.h"
+#include "account.h"
+#include "stats.h"
 
 #define SIZE(a) (sizeof(a)/sizeof(*a))
 
@@ -14,7 +35,7 @@
 /* vmalloc'd buffer */
 int buffer_vmalloc_init(union buffer *buffer, void *data, size_t size) {
 	struct pointer *bp = &buffer->pointer;
-	if (!(bp->p = vmalloc(size)))
+	if (!(bp->p = account_vmalloc(size)))
 		return 1;
 	if (data)
 		memcpy(bp->p, data, size);
@@ -23,15 +44,37 @@ int buffer_vmalloc_init(union buffer *buffer, void *data, size_t size) {
 }
 void buffer_vmalloc_free(union buffer *buffer) {
 	struct pointer *bp = &buffer->pointer;
-	if (bp->p) vfree(bp->p);
+	account_vfree(bp->p, bp->ps);
+}
+size_t buffer_vmalloc_bytes(union buffer *buffer) {
+	return PAGE_ALIGN(buffer->pointer.ps);
+}
+
+/* vmalloc'd buffer mapped with 2M pages where possible */
+int buffer_vmalloc_huge_init(union buffer *buffer, void *data, size_t size) {
+	struct pointer *bp = &buffer->pointer;
+	if (!(bp->p = account_vmalloc_huge(size)))
+		return 1;
+	if (data)
+		memcpy(bp->p, data, size);
+	bp->ps = size;
+	return 0;
+}
+void buffer_vmalloc_huge_free(union buffer *buffer) {
+	struct pointer *bp = &buffer->pointer;
+	account_vfree_huge(bp->p, bp->ps);
+}
+size_t buffer_vmalloc_huge_bytes(union buffer *buffer) {
+	return vmalloc_huge_size(buffer->pointer.ps);
 }
 
 /* kmalloc'd buffer */
 int buffer_kmalloc_init(union buffer *buffer, void *data, size_t size) {
 	struct pointer *bp = &buffer->pointer;
+	bp->p = NULL;
 	if (size > KMALLOC_MAX_SIZE)
 		return 1;
-	if (!(bp->p = kmalloc(size, GFP_KERNEL)))
+	if (!(bp->p = account_kmalloc(size, GFP_KERNEL)))
 		return 1;
 	if (data)
 		memcpy(bp->p, data, size);
@@ -40,46 +83,68 @@ int buffer_kmalloc_init(union buffer *buffer, void *data, size_t size) {
 }
 void buffer_kmalloc_free(union buffer *buffer) {
 	struct pointer *bp = &buffer->pointer;
-	if (bp->p) kfree(bp->p);
+	account_kfree(bp->p);
+}
+size_t buffer_kmalloc_bytes(union buffer *buffer) {
+	return ksize(buffer->pointer.p);
 }
 
 /* -----------------
  * page array buffer
  * ----------------- */
 
-/* connected pages */
+/* connected pages of any size up to the largest buddy order.
+ * alloc_pages_exact gives back the tail of its power of two. MAX_ORDER
+ * became inclusive in 6.4 and was renamed in 6.8 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0)
+#define CPAGES_MAX_ORDER MAX_PAGE_ORDER
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define CPAGES_MAX_ORDER MAX_ORDER
+#else
+#define CPAGES_MAX_ORDER (MAX_ORDER - 1)
+#endif
 int buffer_cpages_init(union buffer *buffer, void *data, size_t size) {
 	struct page_array *bpa = &buffer->page_array;
+	struct page *page;
 	void *pages;
-	int i, order;
+	int i;
 	bpa->ps = DIV_ROUND_UP(size, PAGE_SIZE);
-	order = __builtin_ffs(bpa->ps) - 1;
+	bpa->pagecache = false;
+
+	if (get_order(size) > CPAGES_MAX_ORDER) {
+		pr_alert("cpages holds at most %lu bytes\n", PAGE_SIZE << CPAGES_MAX_ORDER);
+		return 1;
+	}
 
 	/* buffer to store struct page ** */
-	if (!(bpa->p = kmalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
+	if (!(bpa->p = account_kzalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
 		return 1;
-	for (i = 0; i < bpa->ps; i++)
-		bpa->p[i] = 0;
 
 	/* allocate physically connected pages */
-	if (!(pages = (void*)__get_free_pages(GFP_KERNEL, order)))
+	if (!(pages = account_alloc_pages_exact(bpa->ps * PAGE_SIZE, GFP_KERNEL | __GFP_NOWARN)))
 		return 1;
+	page = virt_to_page(pages);
 
 	/* copy into pages */
 	if (data)
 		memcpy(pages, data, size);
 
-	/* get struct page pointer from data pointer, store into struct page ** */
+	/* pages are contiguous, so are their pfns */
 	for (i = 0; i < bpa->ps; i++)
-		bpa->p[i] = virt_to_page(pages + PAGE_SIZE * i);
+		bpa->p[i] = pfn_to_page(page_to_pfn(page) + i);
 
 	return 0;
 }
 void buffer_cpages_free(union buffer *buffer) {
 	struct page_array *bpa = &buffer->page_array;
 	if (!bpa->p) return;
-	__free_pages(bpa->p[0], __builtin_ffs(bpa->ps) - 1);
-	kfree(bpa->p);
+	if (bpa->p[0])
+		account_free_pages_exact(page_address(bpa->p[0]), bpa->ps * PAGE_SIZE);
+	account_kfree(bpa->p);
+}
+size_t buffer_cpages_bytes(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	return bpa->ps * PAGE_SIZE + ksize(bpa->p);
 }
 
 /* disconnected pages */
@@ -87,9 +152,10 @@ int buffer_dpages_init(union buffer *buffer, void *data, size_t size) {
 	struct page_array *bpa = &buffer->page_array;
 	int i;
 	bpa->ps = DIV_ROUND_UP(size, PAGE_SIZE);
+	bpa->pagecache = false;
 
 	/* buffer to store struct page ** */
-	if (!(bpa->p = kmalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
+	if (!(bpa->p = account_kmalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
 		return 1;
 
 	/* set to 0, so cleanup can work even if alloc fails inbetween */
@@ -98,9 +164,10 @@ int buffer_dpages_init(union buffer *buffer, void *data, size_t size) {
 
 	/* alloc single pages */
 	for (i = 0; i < bpa->ps; i++) {
-		if (!(bpa->p[i] = alloc_page(GFP_KERNEL)))
+		if (!(bpa->p[i] = account_alloc_pages(GFP_KERNEL, 0)))
 			return 1;
-		memcpy(page_address(bpa->p[i]), data + i * PAGE_SIZE, PAGE_SIZE);
+		if (data)
+			memcpy(page_address(bpa->p[i]), data + i * PAGE_SIZE, PAGE_SIZE);
 	}
 	return 0;
 }
@@ -109,31 +176,140 @@ void buffer_dpages_free(union buffer *buffer) {
 	int i;
 	if (!bpa->p) return;
 	for (i = 0; i < bpa->ps; i++)
-		if (bpa->p[i])
-			__free_page(bpa->p[i]);
-	kfree(bpa->p);
+		account_free_pages(bpa->p[i], 0);
+	account_kfree(bpa->p);
+}
+size_t buffer_dpages_bytes(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	return bpa->ps * PAGE_SIZE + ksize(bpa->p);
+}
+
+/* 2M compound pages like THP uses them. The array holds all of their 4K
+ * pages, so page array codecs and transforms work unchanged. */
+#define HPAGE_ORDER (PMD_SHIFT - PAGE_SHIFT)
+#define HPAGE_PAGES (1 << HPAGE_ORDER)
+void buffer_hpages_free(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	int i;
+	if (!bpa->p) return;
+	for (i = 0; i < bpa->ps; i += HPAGE_PAGES)
+		account_free_pages(bpa->p[i], HPAGE_ORDER);
+	account_kfree(bpa->p);
+}
+int buffer_hpages_init(union buffer *buffer, void *data, size_t size) {
+	struct page_array *bpa = &buffer->page_array;
+	struct page *page;
+	int i, j;
+	bpa->ps = DIV_ROUND_UP(size, PAGE_SIZE);
+	bpa->pagecache = false;
+
+	/* zeroed, so cleanup can work even if alloc fails inbetween */
+	if (!(bpa->p = account_kzalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
+		return 1;
+
+	for (i = 0; i < bpa->ps; i += HPAGE_PAGES) {
+		if (!(page = account_alloc_pages(GFP_KERNEL | __GFP_COMP | __GFP_NOWARN, HPAGE_ORDER))) {
+			/* 2M pages are scarce, give back the ones taken right away */
+			buffer_hpages_free(buffer);
+			bpa->p = NULL;
+			return 1;
+		}
+		for (j = 0; j < HPAGE_PAGES && i + j < bpa->ps; j++)
+			bpa->p[i + j] = page + j;
+	}
+	if (data)
+		return mem_fill(buffer, PAGE_ARRAY, data, size);
+	return 0;
+}
+size_t buffer_hpages_bytes(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	return (DIV_ROUND_UP(bpa->ps, HPAGE_PAGES) << PMD_SHIFT) + ksize(bpa->p);
+}
+
+/* the page cache pages of the input file, read in if they are not cached
+ * and held by a reference until free. Nothing is copied, data has to be
+ * the whole input as the pages always start at the beginning of the file */
+static struct file *mem_file;
+static void *mem_file_data;
+
+void mem_set_file(struct file *file, void *data) {
+	mem_file = file;
+	mem_file_data = data;
+}
+
+/* read_mapping_page calls the read op of the mapping unchecked. Only
+ * regular files of filesystems with one can be read in, not tmpfs or
+ * procfs ones. readpage became read_folio in 5.19 */
+static bool mem_file_readable(struct file *file) {
+	const struct address_space_operations *a_ops = file->f_mapping->a_ops;
+	if (!S_ISREG(file_inode(file)->i_mode) || !a_ops)
+		return false;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+	return a_ops->read_folio;
+#else
+	return a_ops->readpage;
+#endif
+}
+int buffer_pagecache_init(union buffer *buffer, void *data, size_t size) {
+	struct page_array *bpa = &buffer->page_array;
+	struct page *page;
+	int i;
+	bpa->ps = DIV_ROUND_UP(size, PAGE_SIZE);
+	bpa->pagecache = true;
+	bpa->p = NULL;
+
+	if (!mem_file || (data && data != mem_file_data) || !mem_file_readable(mem_file))
+		return 1;
+	if (!(bpa->p = account_kzalloc(bpa->ps * sizeof(struct page *), GFP_KERNEL)))
+		return 1;
+	for (i = 0; i < bpa->ps; i++) {
+		page = read_mapping_page(mem_file->f_mapping, i, mem_file);
+		if (IS_ERR(page))
+			return 1;
+		bpa->p[i] = page;
+	}
+	return 0;
+}
+void buffer_pagecache_free(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	int i;
+	if (!bpa->p) return;
+	for (i = 0; i < bpa->ps && bpa->p[i]; i++)
+		put_page(bpa->p[i]);
+	account_kfree(bpa->p);
+}
+size_t buffer_pagecache_bytes(union buffer *buffer) {
+	return ksize(buffer->page_array.p);
 }
 
 /* ------------------
  * block array buffer
  * ------------------ */
 
+/* vblocks and kblocks take their block size from mem_block_size, blocks
+ * larger than the input become one block of the input size */
+size_t mem_block_size = 4096;
+
+static size_t buffer_block_size(size_t size) {
+	return clamp_t(size_t, mem_block_size, MEM_BLOCK_MIN, max_t(size_t, size, MEM_BLOCK_MIN));
+}
+
 /* block array, vmalloc */
 int buffer_varray_init(union buffer *buffer, void *data, size_t size, size_t block_size) {
 	struct block_array *bba = &buffer->block_array;
 	int i;
 	bba->bs = DIV_ROUND_UP(size, block_size);
 	bba->block_size = block_size;
-	if (!(bba->b = kmalloc(bba->bs * sizeof(void *), GFP_KERNEL)))
+	if (!(bba->b = account_kvmalloc_array(bba->bs, sizeof(void *), GFP_KERNEL)))
 		return 1;
 	for (i = 0; i < bba->bs; i++)
 		bba->b[i] = 0;
 
 	for (i = 0; i < bba->bs; i++) {
-		if (!(bba->b[i] = vmalloc(block_size)))
+		if (!(bba->b[i] = account_vmalloc(block_size)))
 			return 1;
 		if (data)
-			memcpy(bba->b[i], data + i * block_size, block_size);
+			memcpy(bba->b[i], data + i * block_size, (i + 1) < bba->bs ? block_size : size - block_size * (bba->bs - 1));
 	}
 	return 0;
 }
@@ -142,9 +318,12 @@ void buffer_varray_free(union buffer *buffer) {
 	int i;
 	if (!bba->b) return;
 	for (i = 0; i < bba->bs; i++)
-		if (bba->b[i])
-			vfree(bba->b[i]);
-	kfree(bba->b);
+		account_vfree(bba->b[i], bba->block_size);
+	account_kvfree(bba->b, bba->bs * sizeof(void *));
+}
+size_t buffer_varray_bytes(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	return bba->bs * PAGE_ALIGN(bba->block_size) + account_kvsize(bba->b, bba->bs * sizeof(void *));
 }
 #define buffer_varray_init_variant(block_size) \
 int buffer_varray_init_ ## block_size (union buffer *buffer, void *data, size_t size) { \
@@ -159,6 +338,9 @@ buffer_varray_init_variant(21)
 buffer_varray_init_variant(22)
 buffer_varray_init_variant(23)
 buffer_varray_init_variant(24)
+int buffer_varray_init_runtime(union buffer *buffer, void *data, size_t size) {
+	return buffer_varray_init(buffer, data, size, buffer_block_size(size));
+}
 
 /* block array, kmalloc */
 int buffer_karray_init(union buffer *buffer, void *data, size_t size, size_t block_size) {
@@ -166,16 +348,17 @@ int buffer_karray_init(union buffer *buffer, void *data, size_t size, size_t blo
 	int i;
 	bba->bs = DIV_ROUND_UP(size, block_size);
 	bba->block_size = block_size;
+	bba->b = NULL;
 
-	if (block_size > KMALLOC_MAX_SIZE) 
+	if (block_size > KMALLOC_MAX_SIZE)
 		return 1;
-	if (!(bba->b = kmalloc(bba->bs * sizeof(void *), GFP_KERNEL)))
+	if (!(bba->b = account_kvmalloc_array(bba->bs, sizeof(void *), GFP_KERNEL)))
 		return 1;
 	for (i = 0; i < bba->bs; i++)
 		bba->b[i] = 0;
 
 	for (i = 0; i < bba->bs; i++) {
-		if (!(bba->b[i] = kmalloc(block_size, GFP_KERNEL)))
+		if (!(bba->b[i] = account_kmalloc(block_size, GFP_KERNEL)))
 			return 1;
 		if (data)
 			memcpy(bba->b[i], data + i * block_size, (i + 1) < bba->bs ? block_size : size - block_size * (bba->bs - 1));
@@ -187,9 +370,16 @@ void buffer_karray_free(union buffer *buffer) {
 	int i;
 	if (!bba->b) return;
 	for (i = 0; i < bba->bs; i++)
-		if (bba->b[i])
-			kfree(bba->b[i]);
-	kfree(bba->b);
+		account_kfree(bba->b[i]);
+	account_kvfree(bba->b, bba->bs * sizeof(void *));
+}
+size_t buffer_karray_bytes(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	size_t bytes = account_kvsize(bba->b, bba->bs * sizeof(void *));
+	int i;
+	for (i = 0; i < bba->bs; i++)
+		bytes += ksize(bba->b[i]);
+	return bytes;
 }
 #define buffer_karray_init_variant(block_size) \
 int buffer_karray_init_ ## block_size (union buffer *buffer, void *data, size_t size) { \
@@ -204,34 +394,450 @@ buffer_karray_init_variant(21)
 buffer_karray_init_variant(22)
 buffer_karray_init_variant(23)
 buffer_karray_init_variant(24)
+int buffer_karray_init_runtime(union buffer *buffer, void *data, size_t size) {
+	return buffer_karray_init(buffer, data, size, buffer_block_size(size));
+}
+
+/* -----------------
+ * block arena buffer
+ * ----------------- */
+
+/* cblocks come from a slab cache of the block size, ablocks from a mempool
+ * on top of that cache. The mempool is filled once with enough blocks for
+ * the input and kept across runs and tests, like a service recycling its
+ * buffers. Its alloc function only works for the task filling it under
+ * mem_arena_lock, so mempool_alloc of any other task hands out the
+ * preallocated blocks and fails instead of going to the slab when they are
+ * gone. Filled blocks count as misses, taken ones as hits. Cache and pool are rebuilt when the block size changes
+ * and no block is out. */
+static struct {
+	struct kmem_cache *cache;
+	mempool_t *pool;
+	size_t block_size;
+	int min_nr;
+	struct task_struct *filler;
+	atomic_t out; /* blocks held by buffers */
+	atomic64_t hits, misses, fill_ns;
+} mem_arena;
+static DEFINE_MUTEX(mem_arena_lock);
+
+static void *mem_arena_alloc(gfp_t gfp, void *pool_data) {
+	if (READ_ONCE(mem_arena.filler) != current)
+		return NULL;
+	return account_kmem_cache_alloc(mem_arena.cache, gfp);
+}
+static void mem_arena_release(void *p, void *pool_data) {
+	account_kmem_cache_free(mem_arena.cache, p);
+}
+
+static void mem_arena_destroy(void) {
+	if (mem_arena.pool) mempool_destroy(mem_arena.pool);
+	if (mem_arena.cache) kmem_cache_destroy(mem_arena.cache);
+	mem_arena.pool = NULL;
+	mem_arena.cache = NULL;
+	mem_arena.min_nr = 0;
+}
+
+/* cache for block_size, and a pool of at least min_nr blocks if min_nr is set */
+static int mem_arena_setup(size_t block_size, int min_nr) {
+	int err = 0;
+	u64 t;
+
+	mutex_lock(&mem_arena_lock);
+	if (mem_arena.cache && mem_arena.block_size != block_size) {
+		if (atomic_read(&mem_arena.out)) {
+			err = 1;
+			goto EXIT;
+		}
+		mem_arena_destroy();
+	}
+	if (!mem_arena.cache) {
+		if (!(mem_arena.cache = kmem_cache_create("compbm_blocks", block_size, 0, 0, NULL))) {
+			err = 1;
+			goto EXIT;
+		}
+		mem_arena.block_size = block_size;
+	}
+	if (min_nr > mem_arena.min_nr) {
+		t = stats_now();
+		WRITE_ONCE(mem_arena.filler, current);
+		if (mem_arena.pool)
+			err = mempool_resize(mem_arena.pool, min_nr);
+		else
+			err = !(mem_arena.pool = mempool_create(min_nr, mem_arena_alloc, mem_arena_release, NULL));
+		WRITE_ONCE(mem_arena.filler, NULL);
+		atomic64_add(stats_now() - t, &mem_arena.fill_ns);
+		if (!err) {
+			atomic64_add(min_nr - mem_arena.min_nr, &mem_arena.misses);
+			mem_arena.min_nr = min_nr;
+		}
+	}
+EXIT:
+	mutex_unlock(&mem_arena_lock);
+	return err;
+}
+
+void mem_arena_reset(void) {
+	atomic64_set(&mem_arena.hits, 0);
+	atomic64_set(&mem_arena.misses, 0);
+	atomic64_set(&mem_arena.fill_ns, 0);
+}
+
+void mem_arena_get(struct mem_arena_stats *stats) {
+	stats->hits = atomic64_read(&mem_arena.hits);
+	stats->misses = atomic64_read(&mem_arena.misses);
+	stats->fill_ns = atomic64_read(&mem_arena.fill_ns);
+}
+
+/* on unload, every buffer is gone by then */
+void mem_arena_free(void) {
+	mutex_lock(&mem_arena_lock);
+	mem_arena_destroy();
+	mutex_unlock(&mem_arena_lock);
+}
+
+/* block array, slab cache */
+int buffer_carray_init(union buffer *buffer, void *data, size_t size) {
+	struct block_array *bba = &buffer->block_array;
+	size_t block_size = buffer_block_size(size);
+	int i;
+	bba->bs = DIV_ROUND_UP(size, block_size);
+	bba->block_size = block_size;
+
+	/* zeroed, so cleanup can work even if alloc fails inbetween */
+	if (!(bba->b = account_kvmalloc_array(bba->bs, sizeof(void *), GFP_KERNEL | __GFP_ZERO)))
+		return 1;
+	if (mem_arena_setup(block_size, 0))
+		return 1;
+	for (i = 0; i < bba->bs; i++) {
+		if (!(bba->b[i] = account_kmem_cache_alloc(mem_arena.cache, GFP_KERNEL)))
+			return 1;
+		atomic_inc(&mem_arena.out);
+		if (data)
+			memcpy(bba->b[i], data + i * block_size, (i + 1) < bba->bs ? block_size : size - block_size * (bba->bs - 1));
+	}
+	return 0;
+}
+void buffer_carray_free(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	int i;
+	if (!bba->b) return;
+	for (i = 0; i < bba->bs && bba->b[i]; i++) {
+		atomic_dec(&mem_arena.out);
+		mem_arena_release(bba->b[i], NULL);
+	}
+	account_kvfree(bba->b, bba->bs * sizeof(void *));
+}
+
+/* block array, mempool arena. A miss past the pool goes to the slab cache,
+ * mempool_free puts blocks back into the pool until it is full again */
+int buffer_aarray_init(union buffer *buffer, void *data, size_t size) {
+	struct block_array *bba = &buffer->block_array;
+	size_t block_size = buffer_block_size(size);
+	int i;
+	bba->bs = DIV_ROUND_UP(size, block_size);
+	bba->block_size = block_size;
+
+	if (!(bba->b = account_kvmalloc_array(bba->bs, sizeof(void *), GFP_KERNEL | __GFP_ZERO)))
+		return 1;
+	if (mem_arena_setup(block_size, bba->bs))
+		return 1;
+	for (i = 0; i < bba->bs; i++) {
+		if ((bba->b[i] = mempool_alloc(mem_arena.pool, GFP_NOWAIT))) {
+			atomic64_inc(&mem_arena.hits);
+		} else {
+			if (!(bba->b[i] = account_kmem_cache_alloc(mem_arena.cache, GFP_KERNEL)))
+				return 1;
+			atomic64_inc(&mem_arena.misses);
+		}
+		atomic_inc(&mem_arena.out);
+		if (data)
+			memcpy(bba->b[i], data + i * block_size, (i + 1) < bba->bs ? block_size : size - block_size * (bba->bs - 1));
+	}
+	return 0;
+}
+void buffer_aarray_free(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	int i;
+	if (!bba->b) return;
+	for (i = 0; i < bba->bs && bba->b[i]; i++) {
+		atomic_dec(&mem_arena.out);
+		mempool_free(bba->b[i], mem_arena.pool);
+	}
+	account_kvfree(bba->b, bba->bs * sizeof(void *));
+}
+
+/* blocks are counted with the object size of the cache, pooled or not */
+size_t buffer_arena_bytes(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	return bba->bs * kmem_cache_size(mem_arena.cache) + account_kvsize(bba->b, bba->bs * sizeof(void *));
+}
+
+/* ------------------
+ * scatterlist buffer
+ * ------------------ */
+
+/* fragment 0 draws sizes of 512 bytes up to a page, from a fixed seed so
+ * every init lays out the same list */
+#define FRAGMENT_SEED 42
+static size_t fragment_len(struct rnd_state *rnd, size_t fragment, size_t off, size_t size) {
+	size_t len = fragment ? fragment : 512 * (1 + prandom_u32_state(rnd) % (PAGE_SIZE / 512));
+	len = min_t(size_t, len, PAGE_SIZE - off % PAGE_SIZE);
+	return min_t(size_t, len, size - off);
+}
+
+int buffer_sg_init(union buffer *buffer, void *data, size_t size, size_t fragment) {
+	struct sg_list *bsg = &buffer->sg_list;
+	struct rnd_state rnd;
+	size_t off, len = 0;
+	unsigned int i, n;
+	bsg->ps = DIV_ROUND_UP(size, PAGE_SIZE);
+	bsg->sg = NULL;
+	bsg->nents = 0;
+
+	/* zeroed, so cleanup can work even if alloc fails inbetween */
+	if (!(bsg->p = account_kzalloc(bsg->ps * sizeof(struct page *), GFP_KERNEL)))
+		return 1;
+	for (i = 0; i < bsg->ps; i++)
+		if (!(bsg->p[i] = account_alloc_pages(GFP_KERNEL, 0)))
+			return 1;
+
+	/* count the entries first, then set them with the same sizes */
+	prandom_seed_state(&rnd, FRAGMENT_SEED);
+	for (n = 0, off = 0; off < size; n++, off += len)
+		len = fragment_len(&rnd, fragment, off, size);
+	if (!(bsg->sg = account_vmalloc(n * sizeof(struct scatterlist))))
+		return 1;
+	bsg->nents = n;
+	sg_init_table(bsg->sg, n);
+
+	prandom_seed_state(&rnd, FRAGMENT_SEED);
+	for (i = 0, off = 0; i < n; i++, off += len) {
+		len = fragment_len(&rnd, fragment, off, size);
+		sg_set_page(&bsg->sg[i], bsg->p[off / PAGE_SIZE], len, off % PAGE_SIZE);
+	}
+
+	if (data)
+		return mem_fill(buffer, SG_LIST, data, size);
+	return 0;
+}
+void buffer_sg_free(union buffer *buffer) {
+	struct sg_list *bsg = &buffer->sg_list;
+	int i;
+	if (!bsg->p) return;
+	account_vfree(bsg->sg, bsg->nents * sizeof(struct scatterlist));
+	for (i = 0; i < bsg->ps; i++)
+		account_free_pages(bsg->p[i], 0);
+	account_kfree(bsg->p);
+}
+size_t buffer_sg_bytes(union buffer *buffer) {
+	struct sg_list *bsg = &buffer->sg_list;
+	return bsg->ps * PAGE_SIZE + ksize(bsg->p) + PAGE_ALIGN(bsg->nents * sizeof(struct scatterlist));
+}
+#define buffer_sg_init_variant(name, fragment) \
+int buffer_sg_init_ ## name (union buffer *buffer, void *data, size_t size) { \
+	return buffer_sg_init(buffer, data, size, fragment); \
+}
+buffer_sg_init_variant(512, 512)
+buffer_sg_init_variant(1K, 1024)
+buffer_sg_init_variant(4K, PAGE_SIZE)
+buffer_sg_init_variant(mixed, 0)
+
+/* -------------
+ * bio_vec array
+ * ------------- */
+
+int buffer_bvec_init(union buffer *buffer, void *data, size_t size, size_t fragment) {
+	struct bvec_array *bbv = &buffer->bvec_array;
+	struct rnd_state rnd;
+	size_t off, len = 0;
+	unsigned int i, n;
+	bbv->ps = DIV_ROUND_UP(size, PAGE_SIZE);
+	bbv->size = size;
+	bbv->bv = NULL;
+	bbv->nr = 0;
+
+	/* zeroed, so cleanup can work even if alloc fails inbetween */
+	if (!(bbv->p = account_kzalloc(bbv->ps * sizeof(struct page *), GFP_KERNEL)))
+		return 1;
+	for (i = 0; i < bbv->ps; i++)
+		if (!(bbv->p[i] = account_alloc_pages(GFP_KERNEL, 0)))
+			return 1;
+
+	/* count the segments first, then set them with the same sizes */
+	prandom_seed_state(&rnd, FRAGMENT_SEED);
+	for (n = 0, off = 0; off < size; n++, off += len)
+		len = fragment_len(&rnd, fragment, off, size);
+	if (!(bbv->bv = account_vmalloc(n * sizeof(struct bio_vec))))
+		return 1;
+	bbv->nr = n;
+
+	prandom_seed_state(&rnd, FRAGMENT_SEED);
+	for (i = 0, off = 0; i < n; i++, off += len) {
+		len = fragment_len(&rnd, fragment, off, size);
+		bbv->bv[i].bv_page = bbv->p[off / PAGE_SIZE];
+		bbv->bv[i].bv_len = len;
+		bbv->bv[i].bv_offset = off % PAGE_SIZE;
+	}
+
+	if (data)
+		return mem_fill(buffer, BVEC, data, size);
+	return 0;
+}
+void buffer_bvec_free(union buffer *buffer) {
+	struct bvec_array *bbv = &buffer->bvec_array;
+	int i;
+	if (!bbv->p) return;
+	account_vfree(bbv->bv, bbv->nr * sizeof(struct bio_vec));
+	for (i = 0; i < bbv->ps; i++)
+		account_free_pages(bbv->p[i], 0);
+	account_kfree(bbv->p);
+}
+size_t buffer_bvec_bytes(union buffer *buffer) {
+	struct bvec_array *bbv = &buffer->bvec_array;
+	return bbv->ps * PAGE_SIZE + ksize(bbv->p) + PAGE_ALIGN(bbv->nr * sizeof(struct bio_vec));
+}
+#define buffer_bvec_init_variant(name, fragment) \
+int buffer_bvec_init_ ## name (union buffer *buffer, void *data, size_t size) { \
+	return buffer_bvec_init(buffer, data, size, fragment); \
+}
+buffer_bvec_init_variant(4K, PAGE_SIZE)
+buffer_bvec_init_variant(mixed, 0)
+
+/* iterator over the whole array, WRITE reads from it like a write bio */
+void mem_bvec_iter(struct iov_iter *iter, union buffer *buffer, int direction) {
+	struct bvec_array *bbv = &buffer->bvec_array;
+	iov_iter_bvec(iter, ITER_BVEC_DIR(direction), bbv->bv, bbv->nr, bbv->size);
+}
+
+#ifdef COMPBM_ABD
+/* -------
+ * zfs abd
+ * ------- */
+
+/* zfs allocates from its own caches, scatter abds are page chunks and
+ * linear ones come from the zio_buf caches */
+static enum account_type buffer_abd_type(struct abd_buffer *bab) {
+	return bab->linear ? ACCOUNT_KMALLOC : ACCOUNT_PAGES;
+}
+size_t buffer_abd_bytes(union buffer *buffer) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	return bab->linear ? bab->size : PAGE_ALIGN(bab->size);
+}
+
+/* zfs VERIFYs abds and zio bufs to be at most SPA_MAXBLOCKSIZE, larger
+ * inputs would panic instead of failing */
+int buffer_abd_init(union buffer *buffer, void *data, size_t size, bool linear) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	bab->abd = NULL;
+	if (size > SPA_MAXBLOCKSIZE)
+		return 1;
+	bab->size = size;
+	bab->linear = linear;
+	if (!(bab->abd = linear ? abd_alloc_linear(size, B_FALSE) : abd_alloc(size, B_FALSE)))
+		return 1;
+	account_other(buffer_abd_type(bab), buffer_abd_bytes(buffer));
+	if (data)
+		return mem_fill(buffer, ABD, data, size);
+	return 0;
+}
+void buffer_abd_free(union buffer *buffer) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	if (!bab->abd) return;
+	account_other(buffer_abd_type(bab), -(s64)buffer_abd_bytes(buffer));
+	abd_free(bab->abd);
+}
+int buffer_abd_linear_init(union buffer *buffer, void *data, size_t size) {
+	return buffer_abd_init(buffer, data, size, true);
+}
+int buffer_abd_scatter_init(union buffer *buffer, void *data, size_t size) {
+	return buffer_abd_init(buffer, data, size, false);
+}
+#endif
 
 struct mem_api mem_formats[] = {
 // list_start
-	{POINTER, "vmalloc", buffer_vmalloc_init, buffer_vmalloc_free},
-	{POINTER, "kmalloc", buffer_kmalloc_init, buffer_kmalloc_free},
-	{PAGE_ARRAY, "cpages", buffer_cpages_init, buffer_cpages_free},
-	{PAGE_ARRAY, "dpages", buffer_dpages_init, buffer_dpages_free},
-	{BLOCK_ARRAY, "vblocks_64K", buffer_varray_init_16, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_128K", buffer_varray_init_17, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_256K", buffer_varray_init_18, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_512K", buffer_varray_init_19, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_1M", buffer_varray_init_20, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_2M", buffer_varray_init_21, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_4M", buffer_varray_init_22, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_8M", buffer_varray_init_23, buffer_varray_free},
-	{BLOCK_ARRAY, "vblocks_16M", buffer_varray_init_24, buffer_varray_free},
-	{BLOCK_ARRAY, "kblocks_64K", buffer_karray_init_16, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_128K", buffer_karray_init_17, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_256K", buffer_karray_init_18, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_512K", buffer_karray_init_19, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_1M", buffer_karray_init_20, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_2M", buffer_karray_init_21, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_4M", buffer_karray_init_22, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_8M", buffer_karray_init_23, buffer_karray_free},
-	{BLOCK_ARRAY, "kblocks_16M", buffer_karray_init_24, buffer_karray_free},
+	{POINTER, "vmalloc", buffer_vmalloc_init, buffer_vmalloc_free, buffer_vmalloc_bytes},
+	{POINTER, "vmalloc_huge", buffer_vmalloc_huge_init, buffer_vmalloc_huge_free, buffer_vmalloc_huge_bytes},
+	{POINTER, "kmalloc", buffer_kmalloc_init, buffer_kmalloc_free, buffer_kmalloc_bytes},
+	{PAGE_ARRAY, "cpages", buffer_cpages_init, buffer_cpages_free, buffer_cpages_bytes},
+	{PAGE_ARRAY, "dpages", buffer_dpages_init, buffer_dpages_free, buffer_dpages_bytes},
+	{PAGE_ARRAY, "hpages", buffer_hpages_init, buffer_hpages_free, buffer_hpages_bytes},
+	{PAGE_ARRAY, "pagecache", buffer_pagecache_init, buffer_pagecache_free, buffer_pagecache_bytes},
+	{BLOCK_ARRAY, "vblocks", buffer_varray_init_runtime, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_64K", buffer_varray_init_16, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_128K", buffer_varray_init_17, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_256K", buffer_varray_init_18, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_512K", buffer_varray_init_19, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_1M", buffer_varray_init_20, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_2M", buffer_varray_init_21, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_4M", buffer_varray_init_22, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_8M", buffer_varray_init_23, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "vblocks_16M", buffer_varray_init_24, buffer_varray_free, buffer_varray_bytes},
+	{BLOCK_ARRAY, "kblocks", buffer_karray_init_runtime, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "cblocks", buffer_carray_init, buffer_carray_free, buffer_arena_bytes},
+	{BLOCK_ARRAY, "ablocks", buffer_aarray_init, buffer_aarray_free, buffer_arena_bytes},
+	{BLOCK_ARRAY, "kblocks_64K", buffer_karray_init_16, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_128K", buffer_karray_init_17, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_256K", buffer_karray_init_18, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_512K", buffer_karray_init_19, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_1M", buffer_karray_init_20, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_2M", buffer_karray_init_21, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_4M", buffer_karray_init_22, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_8M", buffer_karray_init_23, buffer_karray_free, buffer_karray_bytes},
+	{BLOCK_ARRAY, "kblocks_16M", buffer_karray_init_24, buffer_karray_free, buffer_karray_bytes},
+	{SG_LIST, "sg_512", buffer_sg_init_512, buffer_sg_free, buffer_sg_bytes},
+	{SG_LIST, "sg_1K", buffer_sg_init_1K, buffer_sg_free, buffer_sg_bytes},
+	{SG_LIST, "sg_4K", buffer_sg_init_4K, buffer_sg_free, buffer_sg_bytes},
+	{SG_LIST, "sg_mixed", buffer_sg_init_mixed, buffer_sg_free, buffer_sg_bytes},
+	{BVEC, "bvec_4K", buffer_bvec_init_4K, buffer_bvec_free, buffer_bvec_bytes},
+	{BVEC, "bvec_mixed", buffer_bvec_init_mixed, buffer_bvec_free, buffer_bvec_bytes},
+#ifdef COMPBM_ABD
+	{ABD, "abd_linear", buffer_abd_linear_init, buffer_abd_free, buffer_abd_bytes},
+	{ABD, "abd_scatter", buffer_abd_scatter_init, buffer_abd_free, buffer_abd_bytes},
+#endif
 // list_end
 };
 
+/* copy data into a buffer allocated by init without data.
+ * The last page or block only gets what is left of data. */
+int mem_fill(union buffer *buffer, enum mem_format format, void *data, size_t size) {
+	struct iov_iter iter;
+	size_t i, n, off;
+	switch (format) {
+	case POINTER:
+		memcpy(buffer->pointer.p, data, size);
+		return 0;
+	case PAGE_ARRAY:
+		/* already holds the file */
+		if (buffer->page_array.pagecache)
+			return 0;
+		for (i = 0, off = 0; i < buffer->page_array.ps && off < size; i++, off += n) {
+			n = min_t(size_t, PAGE_SIZE, size - off);
+			memcpy(page_address(buffer->page_array.p[i]), data + off, n);
+		}
+		return 0;
+	case BLOCK_ARRAY:
+		for (i = 0, off = 0; i < buffer->block_array.bs && off < size; i++, off += n) {
+			n = min_t(size_t, buffer->block_array.block_size, size - off);
+			memcpy(buffer->block_array.b[i], data + off, n);
+		}
+		return 0;
+	case SG_LIST:
+		return sg_copy_from_buffer(buffer->sg_list.sg, buffer->sg_list.nents, data, size) != size;
+	case BVEC:
+		mem_bvec_iter(&iter, buffer, READ);
+		return copy_to_iter(data, size, &iter) != size;
+	case ABD:
+#ifdef COMPBM_ABD
+		abd_copy_from_buf(buffer->abd_buffer.abd, data, size);
+		return 0;
+#endif
+		break;
+	}
+	return 1;
+}
+
 int mem_choose(char *name, struct mem_api *mem_api) {
 	int i;
 	for (i = 0; i < SIZE(mem_formats); i++)
@@ -241,3 +847,11 @@ int mem_choose(char *name, struct mem_api *mem_api) {
 		}
 	return i == SIZE(mem_formats);
 }
+
+/* i-th entry of mem_formats, used to walk the whole list */
+int mem_nth(int i, struct mem_api *mem_api) {
+	if (i < 0 || i >= SIZE(mem_formats))
+		return 1;
+	*mem_api = mem_formats[i];
+	return 0;
+}
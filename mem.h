@@ -1,12 +1,15 @@
 #ifndef mem_h_INCLUDED
 #define mem_h_INCLUDED
 
+#include <linux/version.h>
+
 /* possible buffer formats */
-enum mem_format { PAGE_ARRAY, BLOCK_ARRAY, POINTER };
+enum mem_format { PAGE_ARRAY, BLOCK_ARRAY, POINTER, SG_LIST, BVEC, ABD };
 
 struct page_array {
 	struct page **p;
 	size_t ps;
+	bool pagecache; /* pages of the input file, never written */
 };
 
 struct block_array {
@@ -19,24 +22,86 @@ struct pointer {
 	size_t ps;
 };
 
+/* entries packed into backing pages p in order, none crosses a page */
+struct sg_list {
+	struct scatterlist *sg;
+	unsigned int nents;
+	struct page **p;
+	size_t ps;
+};
+
+/* bio_vec array like a bio carries it, laid out the same way as sg_list */
+struct bvec_array {
+	struct bio_vec *bv;
+	unsigned int nr;
+	size_t size;
+	struct page **p;
+	size_t ps;
+};
+
+/* zfs abd_t, linear or scatter */
+struct abd_buffer {
+	struct abd *abd;
+	size_t size;
+	bool linear;
+};
+
 union buffer {
 	struct block_array block_array;
 	struct pointer pointer;
 	struct page_array page_array;
+	struct sg_list sg_list;
+	struct bvec_array bvec_array;
+	struct abd_buffer abd_buffer;
 };
 
-/* buffer api */
+/* buffer api, init only allocates if data is NULL. bytes is everything the
+ * format allocated, including its array of pages or blocks */
 typedef int (*buffer_init)(union buffer *buffer, void *data, size_t size);
 typedef void (*buffer_free)(union buffer *buffer);
+typedef size_t (*buffer_bytes)(union buffer *buffer);
 
 struct mem_api {
 	enum mem_format format;
 	char *name;
 	buffer_init init;
 	buffer_free free;
+	buffer_bytes bytes;
+};
+
+/* block size of the vblocks and kblocks formats, set at runtime */
+#define MEM_BLOCK_MIN 512
+extern size_t mem_block_size;
+
+/* use of the block arena since mem_arena_reset. Hits are blocks taken from
+ * the preallocated pool, misses are blocks allocated from the slab cache,
+ * filling the pool or when it ran empty. fill_ns is the time spent filling */
+struct mem_arena_stats {
+	u64 hits, misses, fill_ns;
 };
+void mem_arena_reset(void);
+void mem_arena_get(struct mem_arena_stats *stats);
+void mem_arena_free(void);
+
+/* input file the pagecache format maps, data is its copy in memory */
+struct file;
+void mem_set_file(struct file *file, void *data);
+
+/* iov_iter_kvec and iov_iter_bvec took the iterator type along with the
+ * direction before 4.20 */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+#define ITER_KVEC_DIR(direction) (direction)
+#define ITER_BVEC_DIR(direction) (direction)
+#else
+#define ITER_KVEC_DIR(direction) (ITER_KVEC | (direction))
+#define ITER_BVEC_DIR(direction) (ITER_BVEC | (direction))
+#endif
 
+struct iov_iter;
+int mem_fill(union buffer *buffer, enum mem_format format, void *data, size_t size);
+void mem_bvec_iter(struct iov_iter *iter, union buffer *buffer, int direction);
 int mem_choose(char *name, struct mem_api *mem_api);
+int mem_nth(int i, struct mem_api *mem_api);
 
 #endif // mem_h_INCLUDED
 
@@ -13,155 +13,469 @@
 #include "mem.h"
 #include "transform.h"
 #include "compress.h"
+#include "stats.h"
+#include "account.h"
+#include "counters.h"
+#include "control.h"
+#include "results.h"
+#include "mod.h"
 
-#define MAX_FILE_SIZE (1024*1024*1024)
+#define MAX_FILE_SIZE ((size_t)16 << 30)
+/* kernel_read takes and returns int sizes on older kernels */
+#define READ_CHUNK ((size_t)1 << 30)
+/* first buffer for files without a size, doubled while they yield more */
+#define READ_START ((size_t)1 << 20)
 
 static char *path = "/dev/null";
 static char *format_name = "dummy";
 static char *compression_name = "dummy";
 static char *transformation_name = "dummy";
+static bool matrix = false;
+
+struct compbm_state compbm = {
+	.iterations = 5,
+	.warmup = 1,
+	.stream_chunk = 1024 * 1024,
+	.stream_ring = 4,
+};
 
 #define ABORT(error, goto_target) { state = error; goto goto_target; }
-enum state { OK, BUFFER, TRANSFORM, OUTPUT, COMPRESS, CHECK };
-char *state_names[] = { "ok", "buffer_error", "transform_error", "output_buffer_error", "compress_error", "check_failed" };
-long long memory_usage(void) {
-	struct sysinfo mem_info;
-	si_meminfo(&mem_info);
-	return mem_info.freeram;
+/* time and count one run, measured runs add both to phase */
+#define RUN_START() { counters_start(&counters); t = stats_now(); }
+#define RUN_END(phase) { \
+	t = stats_now() - t; \
+	if (i >= warmup) { \
+		stats_add(&stats[phase], t); \
+		counters_stop(&counters, phase); \
+	} \
 }
+char *state_names[] = { "ok", "buffer_error", "transform_error", "output_buffer_error", "compress_error", "check_failed" };
 
 /* run a test for a given file and mem/transform/compression API */
 void test(void *file, size_t file_size, struct mem_api mem, struct compress_api compress, struct transform_api transform) {
-	union buffer buffer;
+	union buffer buffer = { 0 };
 	enum state state = OK;
 	void *buffer_pointer = NULL, *output = NULL, *check = NULL;
-	unsigned long transform_time = 0, compression_time = 0, decompression_time = 0;
+	struct stats stats[PHASES] = { 0 };
+	struct account memory[PHASES];
+	struct counters counters;
+	struct result result;
+	struct compress_ctx *ctx = NULL;
+	size_t workspace = 0, mem_bytes = 0, block_size = 0;
 	long long memory_cost = 0;
-	int compressed_size = 0;
-	int output_len = (file_size * 3) / 2; // some padding for worst case
+	size_t compressed_size = 0;
+	size_t output_len = 0;
+	int i, iterations = compbm.iterations, warmup = compbm.warmup;
+	int runs = warmup + iterations;
+	u64 t, ctx_init_ns = 0;
 
-  /* init the initial format */
-  if (mem.init(&buffer, file, file_size))
-  	ABORT(BUFFER, EXIT0);
+	/* every allocation from here on counts to the phase set last */
+	account_reset();
+	mem_arena_reset();
+	counters_init(&counters);
+	for (i = 0; i < PHASES; i++)
+		if (stats_init(&stats[i], iterations))
+			ABORT(BUFFER, EXIT0);
+
+	/* allocate and populate the initial format, each run but the last one
+	 * frees it again, so alloc, populate and free are timed separately.
+	 * A failed init frees what it got to */
+	for (i = 0; i < runs; i++) {
+		account_phase(ALLOC_PHASE);
+		RUN_START();
+		if (mem.init(&buffer, NULL, file_size)) {
+			mem.free(&buffer);
+			ABORT(BUFFER, EXIT0);
+		}
+		RUN_END(ALLOC_PHASE);
+		account_phase(POPULATE_PHASE);
+		RUN_START();
+		if (mem_fill(&buffer, mem.format, file, file_size))
+			ABORT(BUFFER, EXIT1);
+		RUN_END(POPULATE_PHASE);
+		if (i + 1 == runs)
+			break;
+		account_phase(FREE_PHASE);
+		RUN_START();
+		mem.free(&buffer);
+		RUN_END(FREE_PHASE);
+	}
+	mem_bytes = mem.bytes(&buffer);
+	if (mem.format == BLOCK_ARRAY)
+		block_size = buffer.block_array.block_size;
 
-	/* compression needs a pointer, so transform the buffer */
+	/* compression needs a pointer, so transform the buffer.
+	 * every run but the last one frees its pointer again */
 	if (compress.type == POINTER) {
-	  memory_cost = memory_usage();
-	  transform_time = jiffies;
-	  if (!(buffer_pointer = transform.init(&buffer)))
-		  ABORT(TRANSFORM, EXIT1);
-	  transform_time = jiffies - transform_time;
-	  memory_cost = memory_usage() - memory_cost;
+	  account_phase(TRANSFORM_PHASE);
+	  for (i = 0; i < runs; i++) {
+		  if (i && buffer_pointer)
+			  transform.free(&buffer, buffer_pointer);
+		  RUN_START();
+		  if (!(buffer_pointer = transform.init(&buffer)))
+			  ABORT(TRANSFORM, EXIT1);
+		  RUN_END(TRANSFORM_PHASE);
+	  }
 	}
 
-  /* get output buffer */
-  if (!(output = vmalloc(output_len)))
+  /* get output buffer, as large as the worst case of the compression */
+  account_phase(COMPRESS_PHASE);
+  output_len = compress.bound(&buffer, file_size, compress.level);
+  if (!(output = account_vmalloc(output_len)))
 	  ABORT(OUTPUT, EXIT2);
 
-	/* compress */
-  compression_time = jiffies;
-	if (!(compressed_size = compress.compress(&buffer, output, output_len, buffer_pointer, file_size, compress.level)))
+	/* codec context of this cpu, building one is timed apart from compression */
+	if (!(ctx = compress_get(&ctx_init_ns)))
 		ABORT(COMPRESS, EXIT3);
-	compression_time = jiffies - compression_time;
+	workspace = compress_ctx_workspace(ctx);
+
+	/* compress */
+	for (i = 0; i < runs; i++) {
+		RUN_START();
+		if (!(compressed_size = compress.compress(ctx, &buffer, output, output_len, buffer_pointer, file_size, compress.level)))
+			ABORT(COMPRESS, EXIT4);
+		RUN_END(COMPRESS_PHASE);
+	}
 
   /* get check buffer */
-  if (!(check = vmalloc(file_size)))
+  account_phase(DECOMPRESS_PHASE);
+  if (!(check = account_vmalloc(file_size)))
 	  ABORT(OUTPUT, EXIT4);
 
 	/* decompress */
-  decompression_time = jiffies;
-	compress.decompress(&buffer, check, file_size, output, compressed_size);
-	decompression_time = jiffies - decompression_time;
+	for (i = 0; i < runs; i++) {
+		RUN_START();
+		compress.decompress(ctx, &buffer, check, file_size, output, compressed_size);
+		RUN_END(DECOMPRESS_PHASE);
+	}
 
+	/* verify once, as a measured run */
+	account_phase(VERIFY_PHASE);
+	i = warmup;
+	RUN_START();
 	if (memcmp(file, check, file_size))
 		ABORT(CHECK, EXIT5);
+	RUN_END(VERIFY_PHASE);
 
 EXIT5:
-	vfree(check);
+	account_vfree(check, file_size);
 EXIT4:
+	compress_put(ctx);
 EXIT3:
-	vfree(output);
+	account_vfree(output, output_len);
 EXIT2:
-	if (compress.type == POINTER)
+	if (compress.type == POINTER && buffer_pointer)
 		transform.free(&buffer, buffer_pointer);
 EXIT1:
+	/* the last run is always a measured one */
+	account_phase(FREE_PHASE);
+	i = warmup;
+	RUN_START();
 	mem.free(&buffer);
+	RUN_END(FREE_PHASE);
 EXIT0:
-	pr_alert("%s %s %s %s %s %lu %d %lu %lu %lu %lld\n",
+	/* memory cost of the transformation is what one run of it allocates */
+	account_get(memory);
+	counters_free(&counters);
+	memory_cost = account_sum(memory[TRANSFORM_PHASE].total) / runs;
+	for (i = 0; i < PHASES; i++) {
+		stats_compute(&stats[i]);
+		if (i != TRANSFORM_PHASE || compress.type == POINTER)
+			stats_print(phase_names[i], &stats[i], file_size);
+		if (account_sum(memory[i].total))
+			pr_alert("%s memory peak %lld total %lld bytes\n", phase_names[i],
+			         account_sum(memory[i].peak), account_sum(memory[i].total));
+	}
+	if (ctx_init_ns)
+		pr_alert("context init %llu ns\n", ctx_init_ns);
+	pr_alert("%s allocated %zu bytes\n", mem.name, mem_bytes);
+
+	/* keep everything for debugfs */
+	result = (struct result) {
+		.cpu = raw_smp_processor_id(),
+		.threads = 1,
+		.mem = mem.name,
+		.transform = transform.name,
+		.compress = compress.name,
+		.state = state_names[state],
+		.path = compbm.path,
+		.level = compress.level,
+		.input_size = file_size,
+		.compressed_size = compressed_size,
+		.memory_cost = memory_cost,
+		.mem_bytes = mem_bytes,
+		.block_size = block_size,
+		.workspace = workspace,
+		.ctx_init_ns = ctx_init_ns,
+		.iterations = iterations,
+		.warmup = warmup,
+	};
+	result.node = cpu_to_node(result.cpu);
+	memcpy(result.stats, stats, sizeof(stats));
+	memcpy(result.memory, memory, sizeof(memory));
+	mem_arena_get(&result.arena);
+	memcpy(result.counters, counters.values, sizeof(counters.values));
+	memcpy(result.counter_events, counters.events, sizeof(counters.events));
+	if (results_add(&result))
+		pr_alert("could not store result\n");
+
+	/* summary line, times are medians in ns */
+	pr_alert("%s %s %s %s %s %zu %zu %llu %llu %llu %lld\n",
            mem.name,
            transform.name,
            compress.name,
-           path,
+           compbm.path,
            state_names[state],
            file_size,
            compressed_size,
-           transform_time,
-           compression_time,
-           decompression_time,
+           stats[TRANSFORM_PHASE].median,
+           stats[COMPRESS_PHASE].median,
+           stats[DECOMPRESS_PHASE].median,
            memory_cost);
+
+	for (i = 0; i < PHASES; i++)
+		stats_free(&stats[i]);
 }
 
-static int __init compbm_init(void) {
-	struct mem_api buffer_api;
-	struct compress_api compress_api;
-	struct transform_api transform_api = { 0 };
-	struct file *file = NULL;
-	void *file_buffer = NULL;
-	size_t file_size = 0;
-	loff_t off = 0;
-
-	/* read file into buffer */
-	file = filp_open(path, O_RDONLY, 0);
-	if (file == NULL) {
-		pr_alert("could not open file %s\n", path);
-		return 0;
+/* run every valid mem/transform/compress combination against the same input,
+ * pairing them the same way generate_tests.sh does */
+void test_matrix(void *file, size_t file_size) {
+	struct mem_api mem;
+	struct compress_api compress;
+	struct transform_api transform;
+	int m, c, t;
+
+	for (c = 0; !compress_nth(c, &compress); c++) {
+		if (compress_init(compress, file_size)) {
+			pr_alert("compress_init %s failed\n", compress.name);
+			compress_free();
+			continue;
+		}
+		for (m = 0; !mem_nth(m, &mem); m++) {
+			if (compress.type == POINTER) {
+				for (t = 0; !transform_nth(t, &transform); t++)
+					if (transform.format == mem.format)
+						test(file, file_size, mem, compress, transform);
+			} else if (compress.type == mem.format) {
+				memset(&transform, 0, sizeof(transform));
+				test(file, file_size, mem, compress, transform);
+			}
+		}
+		compress_free();
+	}
+}
+
+/* move the first used bytes of buffer into a new one of size */
+static void *compbm_resize(void *buffer, size_t used, size_t size) {
+	void *p;
+	if ((p = vmalloc(size)))
+		memcpy(p, buffer, used);
+	vfree(buffer);
+	return p;
+}
+
+/* read the file at new_path into the shared input buffer, replacing the old one */
+int compbm_load(char *new_path) {
+	struct file *file;
+	void *file_buffer;
+	size_t size, file_size;
+	ssize_t ret = 0;
+	bool sized;
+
+	file = filp_open(new_path, O_RDONLY, 0);
+	if (IS_ERR_OR_NULL(file)) {
+		pr_alert("could not open file %s\n", new_path);
+		return 1;
 	}
 
-	file_buffer = vmalloc(MAX_FILE_SIZE);
+	/* files without a size, like procfs, pipes or char devices, are read
+	 * into a growing buffer, which is shrunk to what they gave */
+	size = i_size_read(file_inode(file));
+	if (size > MAX_FILE_SIZE) {
+		pr_alert("file %s is larger than %zu bytes\n", new_path, MAX_FILE_SIZE);
+		filp_close(file, NULL);
+		return 1;
+	}
+	sized = size;
+	if (!sized)
+		size = READ_START;
+	file_buffer = vmalloc(size);
+	for (file_size = 0; file_buffer; file_size += ret) {
+		if (file_size == size) {
+			if (sized || size == MAX_FILE_SIZE)
+				break;
+			size = min(size * 2, MAX_FILE_SIZE);
+			if (!(file_buffer = compbm_resize(file_buffer, file_size, size)))
+				break;
+		}
+		if ((ret = compbm_read(file, file_buffer + file_size, min(size - file_size, READ_CHUNK), file_size)) <= 0)
+			break;
+	}
+	if (file_buffer && file_size && file_size < size)
+		file_buffer = compbm_resize(file_buffer, file_size, file_size);
 	if (!file_buffer) {
 		pr_alert("could not allocate buffer\n");
 		filp_close(file, NULL);
-		return 0;
+		return 1;
 	}
-	file_size = kernel_read(file, off, file_buffer, MAX_FILE_SIZE);
-	filp_close(file, NULL);
+	if (ret < 0 || !file_size) {
+		pr_alert("could not read file %s\n", new_path);
+		filp_close(file, NULL);
+		vfree(file_buffer);
+		return 1;
+	}
+	if (!sized && file_size == MAX_FILE_SIZE)
+		pr_alert("file %s truncated to %zu bytes\n", new_path, MAX_FILE_SIZE);
 
-	/* find function structs based on parameter names */
-	/* transform is only needed iff compressor expects a pointer */
-	if (mem_choose(format_name, &buffer_api)) {
-		pr_alert("format %s not found\n", format_name);
-		goto INIT_ERR;
+	/* contexts are sized for the input */
+	compbm_drop_contexts();
+	mem_arena_free();
+	if (compbm.input) vfree(compbm.input);
+	if (compbm.file) filp_close(compbm.file, NULL);
+	compbm.input = file_buffer;
+	compbm.input_size = file_size;
+	/* stays open, the pagecache format uses its pages */
+	compbm.file = file;
+	mem_set_file(file, file_buffer);
+	strscpy(compbm.path, new_path, sizeof(compbm.path));
+	return 0;
+}
+
+/* find function structs based on names, NULL keeps the current choice.
+ * A different codec drops the warm contexts of the old one. */
+int compbm_select(char *format, char *transformation, char *compression) {
+	struct mem_api mem_api;
+	struct transform_api transform_api;
+	struct compress_api compress_api;
+
+	if (format && mem_choose(format, &mem_api)) {
+		pr_alert("format %s not found\n", format);
+		return 1;
 	}
-	if (compress_choose(compression_name, &compress_api)) {
-		pr_alert("compression %s not found\n", compression_name);
-		goto INIT_ERR;
+	if (transformation && transform_choose(transformation, &transform_api)) {
+		pr_alert("transformation %s not found\n", transformation);
+		return 1;
 	}
-	if (compress_api.type == POINTER && transform_choose(transformation_name, &transform_api)) {
-		pr_alert("transformation %s not found\n", transformation_name);
-		goto INIT_ERR;
+	if (compression && compress_choose(compression, &compress_api)) {
+		pr_alert("compression %s not found\n", compression);
+		return 1;
 	}
-	if (compress_api.type == POINTER && buffer_api.format != transform_api.format) {
-		pr_alert("transformation %s not working with %s\n", transformation_name, format_name);
-		goto INIT_ERR;
+
+	if (format)
+		compbm.mem = mem_api;
+	if (transformation)
+		compbm.transform = transform_api;
+	if (compression) {
+		compbm_drop_contexts();
+		compbm.compress = compress_api;
 	}
-	/* zfs_zstd saves context between runs. So we will init non-zfs versions
-   * a context before the benchmark. */
-	if (compress_init(compress_api)) {
+	return 0;
+}
+
+/* free codec contexts, the next run initializes them again */
+void compbm_drop_contexts(void) {
+	if (compbm.compress_ready)
+		compress_free();
+	compbm.compress_ready = false;
+}
+
+/* zfs_zstd saves context between runs. So we will pool non-zfs versions
+ * contexts per cpu, and keep them for the following runs on inputs of size.
+ * A different size builds them again, sized to it. */
+int compbm_contexts(size_t size) {
+	if (compbm.compress_ready && compbm.compress_size == size)
+		return 0;
+	compbm_drop_contexts();
+	if (compress_init(compbm.compress, size)) {
 		pr_alert("compress_init failed\n");
-		goto INIT_ERR;
+		compress_free();
+		return 1;
+	}
+	compbm.compress_size = size;
+	compbm.compress_ready = true;
+	return 0;
+}
+
+/* run the selected combination on the loaded input */
+int compbm_run(void) {
+	struct transform_api transform_api = { 0 };
+
+	if (!compbm.input) {
+		pr_alert("no input loaded\n");
+		return 1;
+	}
+	if (!compbm.mem.name || !compbm.compress.name) {
+		pr_alert("no format or compression selected\n");
+		return 1;
+	}
+
+	/* transform is only needed iff compressor expects a pointer */
+	if (compbm.compress.type == POINTER) {
+		if (!compbm.transform.name) {
+			pr_alert("no transformation selected\n");
+			return 1;
+		}
+		if (compbm.mem.format != compbm.transform.format) {
+			pr_alert("transformation %s not working with %s\n", compbm.transform.name, compbm.mem.name);
+			return 1;
+		}
+		transform_api = compbm.transform;
 	}
 
-	test(file_buffer, file_size, buffer_api, compress_api, transform_api);
-	
-	compress_free();
+	if (compbm_contexts(compbm.input_size))
+		return 1;
+	test(compbm.input, compbm.input_size, compbm.mem, compbm.compress, transform_api);
+	return 0;
+}
 
-INIT_ERR:
-	vfree(file_buffer);
+/* run the matrix on the loaded input, it brings its own codec contexts */
+int compbm_run_matrix(void) {
+	if (!compbm.input) {
+		pr_alert("no input loaded\n");
+		return 1;
+	}
+	compbm_drop_contexts();
+	test_matrix(compbm.input, compbm.input_size);
 	return 0;
 }
 
+/* a load with a path runs once like before, afterwards the module stays
+ * resident and is driven through /sys/kernel/compbm */
+static int __init compbm_init(void) {
+	int err;
+
+	if (compbm.iterations < 1 || compbm.warmup < 0) {
+		pr_alert("invalid iterations %d / warmup %d\n", compbm.iterations, compbm.warmup);
+		return -EINVAL;
+	}
+	/* the same minimums as the control attributes */
+	if (compbm.stream_chunk < 4096 || compbm.stream_ring < 1) {
+		pr_alert("invalid stream_chunk %d / stream_ring %d\n", compbm.stream_chunk, compbm.stream_ring);
+		return -EINVAL;
+	}
+	if ((err = results_init()))
+		return err;
+
+	if (strcmp(path, "/dev/null") && !compbm_load(path)) {
+		if (matrix)
+			compbm_run_matrix();
+		else if (!compbm_select(format_name, NULL, compression_name) &&
+		         (compbm.compress.type != POINTER || !compbm_select(NULL, transformation_name, NULL)))
+			compbm_run();
+	}
+
+	if ((err = control_init()))
+		results_free();
+	return err;
+}
 
 static void __exit compbm_exit(void) {
+	control_free();
+	results_free();
+	compbm_drop_contexts();
+	mem_arena_free();
+	if (compbm.input) vfree(compbm.input);
+	if (compbm.file) filp_close(compbm.file, NULL);
 }
 
 module_init(compbm_init);
@@ -175,9 +489,26 @@ module_param(transformation_name, charp, 0000);
 MODULE_PARM_DESC(transformation_name, "Transformation to use");
 module_param(path, charp, 0000);
 MODULE_PARM_DESC(path, "Absolute path to the test file");
+module_param_named(iterations, compbm.iterations, int, 0000);
+MODULE_PARM_DESC(iterations, "Measured runs per phase");
+module_param_named(warmup, compbm.warmup, int, 0000);
+MODULE_PARM_DESC(warmup, "Unmeasured runs per phase before the measured ones");
+module_param_named(block_size, mem_block_size, ulong, 0000);
+MODULE_PARM_DESC(block_size, "Block size of the vblocks and kblocks formats, at least 512");
+module_param_named(stream_chunk, compbm.stream_chunk, int, 0000);
+MODULE_PARM_DESC(stream_chunk, "Bytes read and compressed at once when streaming a file");
+module_param_named(stream_ring, compbm.stream_ring, int, 0000);
+MODULE_PARM_DESC(stream_ring, "Chunks buffered between reader and compressor");
+module_param_named(stream_direct, compbm.stream_direct, int, 0000);
+MODULE_PARM_DESC(stream_direct, "Stream files with O_DIRECT, needs linux 6.3");
+module_param_named(dest_size, compress_dest_size, ulong, 0000);
+MODULE_PARM_DESC(dest_size, "Output slot size of lz4_destsize, at least 64");
+module_param(matrix, bool, 0000);
+MODULE_PARM_DESC(matrix, "Run all mem/transform/compress combinations, ignoring the names");
 
 MODULE_SOFTDEP("post: zzstd");
 MODULE_SOFTDEP("post: lz4_compress");
 MODULE_SOFTDEP("post: lz4_decompress");
+MODULE_SOFTDEP("post: lz4hc_compress");
 
 MODULE_LICENSE("GPL");
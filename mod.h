@@ -0,0 +1,49 @@
+#ifndef mod_h_INCLUDED
+#define mod_h_INCLUDED
+
+#include <linux/fs.h>
+#include <linux/limits.h>
+#include <linux/version.h>
+#include "mem.h"
+#include "transform.h"
+#include "compress.h"
+
+/* outcome of a test */
+enum state { OK, BUFFER, TRANSFORM, OUTPUT, COMPRESS, CHECK };
+extern char *state_names[];
+
+/* state kept between runs, set by module parameters and the control interface */
+struct compbm_state {
+	char path[PATH_MAX];
+	void *input;
+	size_t input_size;
+	struct file *file; /* kept open while it is the input */
+	struct mem_api mem;
+	struct transform_api transform;
+	struct compress_api compress;
+	bool compress_ready;
+	size_t compress_size; /* input size the contexts are built for */
+	int iterations, warmup;
+	int thread_slice; /* threads compress a slice instead of a copy of the input */
+	int stream_chunk, stream_ring, stream_direct; /* streamed files, O_DIRECT if set */
+};
+
+extern struct compbm_state compbm;
+
+/* kernel_read took the offset first and int sizes before 4.14 */
+static inline ssize_t compbm_read(struct file *file, void *buf, size_t count, loff_t pos) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0)
+	return kernel_read(file, buf, count, &pos);
+#else
+	return kernel_read(file, pos, buf, count);
+#endif
+}
+
+int compbm_load(char *new_path);
+int compbm_select(char *format, char *transformation, char *compression);
+void compbm_drop_contexts(void);
+int compbm_contexts(size_t size);
+int compbm_run(void);
+int compbm_run_matrix(void);
+
+#endif // mod_h_INCLUDED
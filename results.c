@@ -0,0 +1,300 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/utsname.h>
+
+#include "results.h"
+
+/* /sys/kernel/debug/compbm/{results,samples,histograms,memory,counters}, all csv.
+ * The ring keeps the last results_size tests, oldest first. Writing
+ * anything to results clears it. */
+static int results_size = 1024;
+module_param(results_size, int, 0000);
+MODULE_PARM_DESC(results_size, "Number of test results kept for debugfs");
+
+static struct result **ring;
+static int ring_head, ring_count; /* head is the next slot to write */
+static u64 next_id;
+static DEFINE_MUTEX(results_lock);
+static struct dentry *results_dir;
+
+/* log2 buckets, bucket i counts samples in [2^i, 2^(i+1)) ns */
+#define HISTOGRAM_BUCKETS 64
+
+static void result_free(struct result *result) {
+	int i;
+	if (!result) return;
+	for (i = 0; i < PHASES; i++)
+		stats_free(&result->stats[i]);
+	kfree(result->path);
+	kfree(result);
+}
+
+/* store a deep copy of result */
+int results_add(struct result *result) {
+	struct result *r;
+	int i;
+
+	if (!ring)
+		return 1;
+	if (!(r = kmalloc(sizeof(*r), GFP_KERNEL)))
+		return 1;
+	*r = *result;
+	memset(r->stats, 0, sizeof(r->stats));
+	r->path = kstrdup(result->path, GFP_KERNEL);
+	for (i = 0; i < PHASES; i++)
+		if (stats_copy(&r->stats[i], &result->stats[i])) {
+			result_free(r);
+			return 1;
+		}
+
+	mutex_lock(&results_lock);
+	r->id = next_id++;
+	result_free(ring[ring_head]);
+	ring[ring_head] = r;
+	ring_head = (ring_head + 1) % results_size;
+	if (ring_count < results_size)
+		ring_count++;
+	mutex_unlock(&results_lock);
+	return 0;
+}
+
+static void results_clear(void) {
+	int i;
+	mutex_lock(&results_lock);
+	for (i = 0; i < results_size; i++) {
+		result_free(ring[i]);
+		ring[i] = NULL;
+	}
+	ring_head = ring_count = 0;
+	mutex_unlock(&results_lock);
+}
+
+/* -------------
+ * seq_file walk
+ * ------------- */
+
+/* position 0 is the csv header, then the results from oldest to newest */
+static struct result *results_at(loff_t pos) {
+	if (pos < 1 || pos > ring_count)
+		return NULL;
+	return ring[(ring_head - ring_count + pos - 1 + results_size) % results_size];
+}
+static void *results_start(struct seq_file *m, loff_t *pos) {
+	mutex_lock(&results_lock);
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	return results_at(*pos);
+}
+static void *results_next(struct seq_file *m, void *v, loff_t *pos) {
+	++*pos;
+	return results_at(*pos);
+}
+static void results_stop(struct seq_file *m, void *v) {
+	mutex_unlock(&results_lock);
+}
+
+/* summary: one line per test with metadata and per phase statistics */
+static int results_show(struct seq_file *m, void *v) {
+	struct result *r = v;
+	struct stats *s;
+	int i;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "id,kernel,cpu,node,threads,mem,transform,compress,level,path,state,"
+		            "input_size,compressed_size,memory_cost,mem_bytes,block_size,arena_hits,arena_misses,arena_fill_ns,workspace,ctx_init_ns,iterations,warmup,"
+		            "stream_bytes,stream_compressed,stream_ns,read_stall_ns,compress_stall_ns");
+		for (i = 0; i < PHASES; i++)
+			seq_printf(m, ",%s_min,%s_median,%s_mean,%s_p99,%s_stddev,%s_mbps",
+			           phase_names[i], phase_names[i], phase_names[i],
+			           phase_names[i], phase_names[i], phase_names[i]);
+		seq_putc(m, '\n');
+		return 0;
+	}
+
+	seq_printf(m, "%llu,%s,%d,%d,%d,%s,%s,%s,%d,%s,%s,%zu,%zu,%lld,%zu,%zu,%llu,%llu,%llu,%zu,%llu,%d,%d,%llu,%llu,%llu,%llu,%llu",
+	           r->id, init_utsname()->release, r->cpu, r->node, r->threads,
+	           r->mem, r->transform ? r->transform : "-", r->compress, r->level,
+	           r->path ? r->path : "-", r->state,
+	           r->input_size, r->compressed_size, r->memory_cost, r->mem_bytes, r->block_size,
+	           r->arena.hits, r->arena.misses, r->arena.fill_ns, r->workspace, r->ctx_init_ns,
+	           r->iterations, r->warmup,
+	           r->stream.bytes, r->stream.compressed, r->stream.ns,
+	           r->stream.read_stall_ns, r->stream.compress_stall_ns);
+	for (i = 0; i < PHASES; i++) {
+		s = &r->stats[i];
+		seq_printf(m, ",%llu,%llu,%llu,%llu,%llu,%llu",
+		           s->min, s->median, s->mean, s->p99, s->stddev,
+		           stats_mbps(r->input_size, s->median));
+	}
+	seq_putc(m, '\n');
+	return 0;
+}
+
+/* samples: every measured run in the order it was taken */
+static int samples_show(struct seq_file *m, void *v) {
+	struct result *r = v;
+	int i, j;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "id,phase,iteration,ns\n");
+		return 0;
+	}
+	for (i = 0; i < PHASES; i++)
+		for (j = 0; j < r->stats[i].count; j++)
+			seq_printf(m, "%llu,%s,%d,%llu\n", r->id, phase_names[i], j, r->stats[i].samples[j]);
+	return 0;
+}
+
+/* histograms: non-empty log2 buckets, bucket_ns is the lower bound */
+static int histograms_show(struct seq_file *m, void *v) {
+	struct result *r = v;
+	unsigned int buckets[HISTOGRAM_BUCKETS];
+	int i, j;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "id,phase,bucket_ns,count\n");
+		return 0;
+	}
+	for (i = 0; i < PHASES; i++) {
+		memset(buckets, 0, sizeof(buckets));
+		for (j = 0; j < r->stats[i].count; j++)
+			buckets[r->stats[i].samples[j] ? ilog2(r->stats[i].samples[j]) : 0]++;
+		for (j = 0; j < HISTOGRAM_BUCKETS; j++)
+			if (buckets[j])
+				seq_printf(m, "%llu,%s,%llu,%u\n", r->id, phase_names[i], 1ULL << j, buckets[j]);
+	}
+	return 0;
+}
+
+/* memory: peak and total bytes per phase and allocator */
+static int memory_show(struct seq_file *m, void *v) {
+	struct result *r = v;
+	int i, j;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "id,phase,allocator,peak,total\n");
+		return 0;
+	}
+	for (i = 0; i < PHASES; i++)
+		for (j = 0; j < ACCOUNT_TYPES; j++)
+			seq_printf(m, "%llu,%s,%s,%lld,%lld\n", r->id, phase_names[i], account_type_names[j],
+			           r->memory[i].peak[j], r->memory[i].total[j]);
+	return 0;
+}
+
+/* counters: cpu events per phase, event NA and no value if the counter
+ * was not available in hardware */
+static int counters_show(struct seq_file *m, void *v) {
+	struct result *r = v;
+	int i, j;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_puts(m, "id,phase,counter,event,value\n");
+		return 0;
+	}
+	for (i = 0; i < PHASES; i++)
+		for (j = 0; j < COUNTERS; j++)
+			if (r->counter_events[j])
+				seq_printf(m, "%llu,%s,%s,%s,%llu\n", r->id, phase_names[i], counter_names[j],
+				           r->counter_events[j], r->counters[i][j]);
+			else
+				seq_printf(m, "%llu,%s,%s,NA,\n", r->id, phase_names[i], counter_names[j]);
+	return 0;
+}
+
+#define results_seq_file(name) \
+static const struct seq_operations name ## _seq_ops = { \
+	.start = results_start, \
+	.next = results_next, \
+	.stop = results_stop, \
+	.show = name ## _show, \
+}; \
+static int name ## _open(struct inode *inode, struct file *file) { \
+	return seq_open(file, &name ## _seq_ops); \
+}
+results_seq_file(results)
+results_seq_file(samples)
+results_seq_file(histograms)
+results_seq_file(memory)
+results_seq_file(counters)
+
+static ssize_t results_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+	results_clear();
+	return count;
+}
+
+static const struct file_operations results_fops = {
+	.owner = THIS_MODULE,
+	.open = results_open,
+	.read = seq_read,
+	.write = results_write,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+static const struct file_operations samples_fops = {
+	.owner = THIS_MODULE,
+	.open = samples_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+static const struct file_operations histograms_fops = {
+	.owner = THIS_MODULE,
+	.open = histograms_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+static const struct file_operations memory_fops = {
+	.owner = THIS_MODULE,
+	.open = memory_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+static const struct file_operations counters_fops = {
+	.owner = THIS_MODULE,
+	.open = counters_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release,
+};
+
+int results_init(void) {
+	if (results_size < 1)
+		return -EINVAL;
+	if (!(ring = kcalloc(results_size, sizeof(*ring), GFP_KERNEL)))
+		return -ENOMEM;
+
+	/* debugfs is optional, results are still printed */
+	results_dir = debugfs_create_dir(KBUILD_MODNAME, NULL);
+	if (IS_ERR_OR_NULL(results_dir)) {
+		pr_alert("debugfs not available, results are only printed\n");
+		results_dir = NULL;
+		return 0;
+	}
+	debugfs_create_file("results", 0644, results_dir, NULL, &results_fops);
+	debugfs_create_file("samples", 0444, results_dir, NULL, &samples_fops);
+	debugfs_create_file("histograms", 0444, results_dir, NULL, &histograms_fops);
+	debugfs_create_file("memory", 0444, results_dir, NULL, &memory_fops);
+	debugfs_create_file("counters", 0444, results_dir, NULL, &counters_fops);
+	return 0;
+}
+
+void results_free(void) {
+	debugfs_remove_recursive(results_dir);
+	results_dir = NULL;
+	if (!ring) return;
+	results_clear();
+	kfree(ring);
+	ring = NULL;
+}
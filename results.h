@@ -0,0 +1,39 @@
+#ifndef results_h_INCLUDED
+#define results_h_INCLUDED
+
+#include "stats.h"
+#include "account.h"
+#include "counters.h"
+#include "mem.h"
+#include "stream.h"
+
+/* one finished test, kept in a ring exported through debugfs */
+struct result {
+	u64 id;
+	int cpu, node, threads;
+	/* names point into the api lists, path is copied */
+	char *mem, *transform, *compress, *state, *path;
+	int level;
+	size_t input_size;
+	size_t compressed_size;
+	long long memory_cost; /* allocated by one transform run */
+	size_t mem_bytes; /* allocated by the mem format */
+	size_t block_size; /* of block array formats, 0 for others */
+	struct mem_arena_stats arena; /* block arena hits and cold allocations */
+	size_t workspace; /* codec context */
+	u64 ctx_init_ns; /* building codec contexts, 0 if all were cached */
+	/* streamed files, input_size is the chunk size there */
+	struct stream_stats stream;
+	int iterations, warmup;
+	struct stats stats[PHASES];
+	struct account memory[PHASES];
+	/* event names point into counters.c, NULL if not counted */
+	u64 counters[PHASES][COUNTERS];
+	char *counter_events[COUNTERS];
+};
+
+int results_init(void);
+void results_free(void);
+int results_add(struct result *result);
+
+#endif // results_h_INCLUDED
@@ -0,0 +1,122 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/sort.h>
+
+#include "stats.h"
+
+char *phase_names[] = { "alloc", "populate", "transform", "compress", "decompress", "verify", "free" };
+
+/* samples and sorted share one allocation */
+int stats_init(struct stats *stats, int n) {
+	memset(stats, 0, sizeof(*stats));
+	if (n < 1)
+		return 1;
+	if (!(stats->samples = kmalloc_array(2 * n, sizeof(u64), GFP_KERNEL)))
+		return 1;
+	stats->sorted = stats->samples + n;
+	stats->n = n;
+	prandom_seed_state(&stats->rnd, n);
+	return 0;
+}
+void stats_free(struct stats *stats) {
+	if (stats->samples) kfree(stats->samples);
+	stats->samples = stats->sorted = NULL;
+}
+
+/* deep copy, dest has to be freed with stats_free */
+int stats_copy(struct stats *dest, struct stats *src) {
+	u64 *samples;
+	if (!src->samples) {
+		*dest = *src;
+		return 0;
+	}
+	if (!(samples = kmalloc_array(2 * src->n, sizeof(u64), GFP_KERNEL)))
+		return 1;
+	memcpy(samples, src->samples, 2 * src->n * sizeof(u64));
+	*dest = *src;
+	dest->samples = samples;
+	dest->sorted = samples + src->n;
+	return 0;
+}
+
+void stats_add(struct stats *stats, u64 ns) {
+	if (stats->count < stats->n)
+		stats->samples[stats->count++] = ns;
+}
+
+/* reservoir sampling for runs of unknown length. Once full, the i-th
+ * sample replaces a random one with probability n/i, so the kept samples
+ * stay a uniform pick of all of them */
+void stats_sample(struct stats *stats, u64 ns) {
+	u32 i;
+	if (stats->seen < U32_MAX)
+		stats->seen++;
+	if (stats->count < stats->n) {
+		stats->samples[stats->count++] = ns;
+		return;
+	}
+	i = ((u64)prandom_u32_state(&stats->rnd) * stats->seen) >> 32;
+	if (i < stats->n)
+		stats->samples[i] = ns;
+}
+
+static int stats_cmp(const void *a, const void *b) {
+	u64 x = *(u64 *)a, y = *(u64 *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* p99 uses the nearest-rank method. Deviations are scaled down by shift
+ * until n of their squares fit into u64, which only costs precision once
+ * runs are seconds apart */
+void stats_compute(struct stats *stats) {
+	u64 sum = 0, var = 0, diff, *sorted = stats->sorted;
+	int i, n = stats->count, shift = 0;
+
+	if (!n)
+		return;
+	memcpy(sorted, stats->samples, n * sizeof(u64));
+	sort(sorted, n, sizeof(u64), stats_cmp, NULL);
+	for (i = 0; i < n; i++)
+		sum += sorted[i];
+
+	stats->min = sorted[0];
+	stats->max = sorted[n - 1];
+	stats->mean = div64_u64(sum, n);
+	stats->median = n % 2 ? sorted[n / 2]
+		: (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+	stats->p99 = sorted[DIV_ROUND_UP(n * 99, 100) - 1];
+
+	while (((stats->max - stats->min) >> shift) >= 1ULL << ((63 - ilog2(n)) / 2))
+		shift++;
+	for (i = 0; i < n; i++) {
+		diff = sorted[i] > stats->mean
+			? sorted[i] - stats->mean : stats->mean - sorted[i];
+		diff >>= shift;
+		var += diff * diff;
+	}
+	stats->stddev = (u64)int_sqrt(div64_u64(var, n)) << shift;
+}
+
+/* bytes per ns * 1000 = MB/s */
+u64 stats_mbps(size_t bytes, u64 ns) {
+	if (!ns)
+		return 0;
+	return div64_u64((u64)bytes * 1000, ns);
+}
+
+void stats_print(char *phase, struct stats *stats, size_t bytes) {
+	pr_alert("%s n=%d min=%llu median=%llu mean=%llu p99=%llu stddev=%llu ns %llu MB/s\n",
+	         phase,
+	         stats->count,
+	         stats->min,
+	         stats->median,
+	         stats->mean,
+	         stats->p99,
+	         stats->stddev,
+	         stats_mbps(bytes, stats->median));
+}
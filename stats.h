@@ -0,0 +1,37 @@
+#ifndef stats_h_INCLUDED
+#define stats_h_INCLUDED
+
+#include <linux/types.h>
+#include <linux/random.h>
+#include <linux/timekeeping.h>
+
+/* phases of one test run */
+enum phase { ALLOC_PHASE, POPULATE_PHASE, TRANSFORM_PHASE, COMPRESS_PHASE, DECOMPRESS_PHASE, VERIFY_PHASE, FREE_PHASE, PHASES };
+extern char *phase_names[];
+
+/* samples of one benchmark phase in ns, in the order they were taken.
+ * stats_compute summarizes them using a sorted copy. seen counts the
+ * samples offered to stats_sample, which keeps at most n of them */
+struct stats {
+	u64 *samples, *sorted;
+	int n, count;
+	u32 seen;
+	struct rnd_state rnd;
+	u64 min, max, median, mean, p99, stddev;
+};
+
+int stats_init(struct stats *stats, int n);
+int stats_copy(struct stats *dest, struct stats *src);
+void stats_free(struct stats *stats);
+void stats_add(struct stats *stats, u64 ns);
+void stats_sample(struct stats *stats, u64 ns);
+void stats_compute(struct stats *stats);
+u64 stats_mbps(size_t bytes, u64 ns);
+void stats_print(char *phase, struct stats *stats, size_t bytes);
+
+/* monotonic clock used for all phase timings */
+static inline u64 stats_now(void) {
+	return ktime_get_ns();
+}
+
+#endif // stats_h_INCLUDED
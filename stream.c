@@ -0,0 +1,245 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/completion.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/semaphore.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+#include "mod.h"
+#include "stats.h"
+#include "account.h"
+#include "results.h"
+#include "stream.h"
+
+/* A reader kthread fills a ring of stream_ring chunk buffers from the file
+ * while the caller compresses the filled ones, so memory stays the same for
+ * any file size and reading overlaps with compression. free counts empty
+ * slots, full the ones waiting for compression. A read of 0 ends the
+ * stream, a negative one fails it. Every chunk is decompressed and checked
+ * against its slot before the slot goes back to the reader. Per chunk
+ * timings are a reservoir of STREAM_SAMPLES, the stream totals count every
+ * chunk, so memory does not grow with the file. */
+#define STREAM_SAMPLES 4096
+
+struct stream_slot {
+	void *data;
+	ssize_t len;
+};
+
+struct stream {
+	struct file *file;
+	struct stream_slot *slot;
+	int slots;
+	size_t chunk;
+	struct semaphore free, full;
+	bool stop; /* compression failed, the reader ends with the next slot */
+	struct stats *read; /* reading a chunk counts as populating it */
+	u64 compress_stall_ns;
+	struct completion done;
+};
+
+static int stream_reader(void *data) {
+	struct stream *s = data;
+	struct stream_slot *slot;
+	loff_t off = 0;
+	u64 t;
+	int i;
+
+	for (i = 0; ; i++) {
+		t = stats_now();
+		down(&s->free);
+		s->compress_stall_ns += stats_now() - t;
+		if (READ_ONCE(s->stop))
+			break;
+		slot = &s->slot[i % s->slots];
+		t = stats_now();
+		slot->len = compbm_read(s->file, slot->data, s->chunk, off);
+		stats_sample(s->read, stats_now() - t);
+		up(&s->full);
+		if (slot->len <= 0)
+			break;
+		off += slot->len;
+	}
+	complete(&s->done);
+
+	/* stay around for kthread_stop */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void stream_free(struct stream *s) {
+	int i;
+	if (s->slot)
+		for (i = 0; i < s->slots; i++)
+			account_vfree(s->slot[i].data, s->chunk);
+	account_kfree(s->slot);
+	if (s->file) filp_close(s->file, NULL);
+}
+
+int stream_run(char *path) {
+	struct compress_api compress = compbm.compress;
+	struct stream s = { 0 };
+	struct stream_stats totals = { 0 };
+	struct stream_slot *slot;
+	struct stats stats[PHASES] = { 0 };
+	struct account memory[PHASES];
+	struct task_struct *reader;
+	struct compress_ctx *ctx = NULL;
+	struct result result;
+	union buffer buffer = { 0 };
+	void *output = NULL, *check = NULL;
+	size_t output_len, compressed_size;
+	int chunks, i, state = OK, err = 1;
+	u64 t, start, ctx_init_ns;
+
+	if (!compress.name || compress.type != POINTER) {
+		pr_alert("streaming needs a compression working on pointers\n");
+		return 1;
+	}
+	s.chunk = compbm.stream_chunk;
+	s.slots = compbm.stream_ring;
+	/* direct io takes the pages of kvec iterators, vmalloc'd ones included,
+	 * only since iov_iter_extract_pages in 6.3 */
+	if (compbm.stream_direct && LINUX_VERSION_CODE < KERNEL_VERSION(6, 3, 0)) {
+		pr_alert("O_DIRECT into vmalloc'd chunks needs linux 6.3\n");
+		return 1;
+	}
+	if (compbm.stream_direct && !PAGE_ALIGNED(s.chunk)) {
+		pr_alert("O_DIRECT needs a chunk size aligned to pages\n");
+		return 1;
+	}
+	output_len = compress.bound(&buffer, s.chunk, compress.level);
+
+	s.file = filp_open(path, O_RDONLY | (compbm.stream_direct ? O_DIRECT : 0), 0);
+	if (IS_ERR_OR_NULL(s.file)) {
+		pr_alert("could not open file %s\n", path);
+		return 1;
+	}
+	/* the reader takes one more sample for the end of the file */
+	chunks = min_t(loff_t, DIV_ROUND_UP(i_size_read(file_inode(s.file)), s.chunk) + 1, STREAM_SAMPLES);
+
+	/* the ring, context and buffers are everything the stream needs */
+	account_reset();
+	account_phase(ALLOC_PHASE);
+	for (i = 0; i < PHASES; i++)
+		if (stats_init(&stats[i], chunks))
+			goto ERR;
+	s.read = &stats[POPULATE_PHASE];
+	if (!(s.slot = account_kzalloc(s.slots * sizeof(*s.slot), GFP_KERNEL)))
+		goto ERR;
+	for (i = 0; i < s.slots; i++)
+		if (!(s.slot[i].data = account_vmalloc(s.chunk)))
+			goto ERR;
+	if (!(output = account_vmalloc(output_len)) || !(check = account_vmalloc(s.chunk)))
+		goto ERR;
+	t = stats_now();
+	if (!(ctx = compress_ctx_init(compress, s.chunk)))
+		goto ERR;
+	ctx_init_ns = stats_now() - t;
+
+	sema_init(&s.free, s.slots);
+	sema_init(&s.full, 0);
+	init_completion(&s.done);
+	account_phase(COMPRESS_PHASE);
+	start = stats_now();
+	reader = kthread_run(stream_reader, &s, "compbm/stream");
+	if (IS_ERR(reader)) {
+		pr_alert("could not start reader\n");
+		goto ERR;
+	}
+
+	for (i = 0; ; i++) {
+		t = stats_now();
+		down(&s.full);
+		totals.read_stall_ns += stats_now() - t;
+		slot = &s.slot[i % s.slots];
+		if (slot->len <= 0) {
+			if (slot->len < 0)
+				state = BUFFER;
+			break;
+		}
+
+		t = stats_now();
+		compressed_size = compress.compress(ctx, &buffer, output, output_len, slot->data, slot->len, compress.level);
+		stats_sample(&stats[COMPRESS_PHASE], stats_now() - t);
+		if (!compressed_size) {
+			state = COMPRESS;
+			break;
+		}
+		t = stats_now();
+		compress.decompress(ctx, &buffer, check, slot->len, output, compressed_size);
+		stats_sample(&stats[DECOMPRESS_PHASE], stats_now() - t);
+		t = stats_now();
+		if (memcmp(slot->data, check, slot->len)) {
+			state = CHECK;
+			break;
+		}
+		stats_sample(&stats[VERIFY_PHASE], stats_now() - t);
+
+		totals.bytes += slot->len;
+		totals.compressed += compressed_size;
+		up(&s.free);
+	}
+	/* let a reader waiting for a slot see stop */
+	WRITE_ONCE(s.stop, true);
+	up(&s.free);
+	wait_for_completion(&s.done);
+	kthread_stop(reader);
+	totals.ns = stats_now() - start;
+	totals.compress_stall_ns = s.compress_stall_ns;
+
+	account_get(memory);
+	for (i = 0; i < PHASES; i++)
+		stats_compute(&stats[i]);
+	pr_alert("stream %s %s %llu bytes %llu MB/s, %s bound, read stall %llu ns, compress stall %llu ns\n",
+	         compress.name, state_names[state], totals.bytes, stats_mbps(totals.bytes, totals.ns),
+	         totals.read_stall_ns > totals.compress_stall_ns ? "io" : "cpu",
+	         totals.read_stall_ns, totals.compress_stall_ns);
+	pr_alert("stream memory peak %lld bytes\n", account_sum(memory[ALLOC_PHASE].peak));
+
+	/* per chunk samples */
+	result = (struct result) {
+		.cpu = raw_smp_processor_id(),
+		.threads = 1,
+		.mem = "stream",
+		.compress = compress.name,
+		.state = state_names[state],
+		.path = path,
+		.level = compress.level,
+		.input_size = s.chunk,
+		.workspace = compress_ctx_workspace(ctx),
+		.ctx_init_ns = ctx_init_ns,
+		.iterations = stats[COMPRESS_PHASE].seen,
+		.stream = totals,
+	};
+	result.node = cpu_to_node(result.cpu);
+	memcpy(result.stats, stats, sizeof(stats));
+	memcpy(result.memory, memory, sizeof(memory));
+	if (results_add(&result))
+		pr_alert("could not store result\n");
+	err = state != OK;
+	goto EXIT;
+
+ERR:
+	pr_alert("could not set up stream\n");
+EXIT:
+	compress_ctx_free(ctx);
+	account_vfree(check, s.chunk);
+	account_vfree(output, output_len);
+	for (i = 0; i < PHASES; i++)
+		stats_free(&stats[i]);
+	stream_free(&s);
+	return err;
+}
@@ -0,0 +1,15 @@
+#ifndef stream_h_INCLUDED
+#define stream_h_INCLUDED
+
+#include <linux/types.h>
+
+/* totals of a streamed file. read_stall is the compressor waiting for the
+ * reader, compress_stall the reader waiting for a free slot in the ring */
+struct stream_stats {
+	u64 bytes, compressed, ns, read_stall_ns, compress_stall_ns;
+};
+
+/* compress the file at path chunk by chunk while a kthread reads ahead */
+int stream_run(char *path);
+
+#endif // stream_h_INCLUDED
@@ -0,0 +1,267 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+#include <linux/printk.h>
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/vmalloc.h>
+
+#include "mod.h"
+#include "stats.h"
+#include "account.h"
+#include "results.h"
+#include "threads.h"
+
+/* Every thread takes the pooled codec context of its cpu, its own copy of the input in the
+ * selected format and its own output buffer, all set up on its cpu.
+ * Timing starts for all threads at once and ends with the slowest one. */
+struct thread_bench {
+	struct task_struct *task;
+	int cpu, err;
+	void *src;
+	size_t src_size;
+	struct compress_ctx *ctx;
+	size_t workspace;
+	u64 ctx_init_ns;
+	union buffer buffer;
+	void *buffer_pointer, *output;
+	size_t output_len, compressed_size;
+	struct stats stats;
+	u64 time; /* all measured iterations */
+	struct completion ready, done;
+};
+
+static struct completion threads_go;
+
+/* cleanup for whatever thread_setup got to, a failed mem.init included */
+static void thread_teardown(struct thread_bench *tb) {
+	account_vfree(tb->output, tb->output_len);
+	if (tb->buffer_pointer) compbm.transform.free(&tb->buffer, tb->buffer_pointer);
+	compbm.mem.free(&tb->buffer);
+	stats_free(&tb->stats);
+}
+
+static int thread_setup(struct thread_bench *tb) {
+	if (compbm.mem.init(&tb->buffer, tb->src, tb->src_size))
+		return BUFFER;
+	if (compbm.compress.type == POINTER && !(tb->buffer_pointer = compbm.transform.init(&tb->buffer)))
+		return TRANSFORM;
+	tb->output_len = compbm.compress.bound(&tb->buffer, tb->src_size, compbm.compress.level);
+	if (!(tb->output = account_vmalloc(tb->output_len)))
+		return OUTPUT;
+	if (!(tb->ctx = compress_get(&tb->ctx_init_ns)))
+		return COMPRESS;
+	tb->workspace = compress_ctx_workspace(tb->ctx);
+	if (stats_init(&tb->stats, compbm.iterations))
+		return OUTPUT;
+	return OK;
+}
+
+/* decompress the last output once and compare against the source */
+static int thread_check(struct thread_bench *tb) {
+	void *check;
+	int ret = OK;
+	if (!(check = account_vmalloc(tb->src_size)))
+		return OUTPUT;
+	compbm.compress.decompress(tb->ctx, &tb->buffer, check, tb->src_size, tb->output, tb->compressed_size);
+	if (memcmp(tb->src, check, tb->src_size))
+		ret = CHECK;
+	account_vfree(check, tb->src_size);
+	return ret;
+}
+
+static int thread_bench_fn(void *data) {
+	struct thread_bench *tb = data;
+	struct compress_api compress = compbm.compress;
+	int i;
+	u64 t, start;
+
+	/* warmup runs stay outside of the measurement */
+	if (!(tb->err = thread_setup(tb)))
+		for (i = 0; i < compbm.warmup; i++)
+			if (!(tb->compressed_size = compress.compress(tb->ctx, &tb->buffer, tb->output, tb->output_len,
+			                                             tb->buffer_pointer, tb->src_size, compress.level)))
+				tb->err = COMPRESS;
+	complete(&tb->ready);
+	wait_for_completion(&threads_go);
+
+	start = stats_now();
+	for (i = 0; !tb->err && i < compbm.iterations; i++) {
+		t = stats_now();
+		if (!(tb->compressed_size = compress.compress(tb->ctx, &tb->buffer, tb->output, tb->output_len,
+		                                             tb->buffer_pointer, tb->src_size, compress.level))) {
+			tb->err = COMPRESS;
+			break;
+		}
+		stats_add(&tb->stats, stats_now() - t);
+	}
+	tb->time = stats_now() - start;
+
+	if (!tb->err)
+		tb->err = thread_check(tb);
+	/* still bound to the cpu, so the context goes back to its slot */
+	compress_put(tb->ctx);
+	tb->ctx = NULL;
+	complete(&tb->done);
+
+	/* stay around for kthread_stop */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+/* run n threads on the first n cpus of cpus, report per thread and aggregate MB/s */
+static int threads_run_n(int *cpus, int n) {
+	struct thread_bench *tbs;
+	struct result result;
+	struct stats all;
+	size_t slice = compbm.input_size / n, bytes = 0;
+	u64 wall = 0, ctx_init_ns = 0;
+	int i, j, started, state = OK, err = 0;
+
+	/* contexts fit the largest input a thread gets, the last slice */
+	if (compbm_contexts(compbm.thread_slice ? compbm.input_size - (n - 1) * slice : compbm.input_size))
+		return 1;
+	if (!(tbs = kcalloc(n, sizeof(*tbs), GFP_KERNEL)))
+		return 1;
+	if (stats_init(&all, n * compbm.iterations)) {
+		kfree(tbs);
+		return 1;
+	}
+	init_completion(&threads_go);
+	/* threads set up and compress concurrently, all of it counts to compress */
+	account_reset();
+	mem_arena_reset();
+	account_phase(COMPRESS_PHASE);
+
+	for (i = 0; i < n; i++) {
+		tbs[i].cpu = cpus[i];
+		/* either every thread gets the whole input, or its slice of it */
+		tbs[i].src = compbm.input;
+		tbs[i].src_size = compbm.input_size;
+		if (compbm.thread_slice) {
+			tbs[i].src += i * slice;
+			tbs[i].src_size = (i + 1) < n ? slice : compbm.input_size - i * slice;
+		}
+		init_completion(&tbs[i].ready);
+		init_completion(&tbs[i].done);
+		tbs[i].task = kthread_create_on_node(thread_bench_fn, &tbs[i], cpu_to_node(cpus[i]), "compbm/%d", cpus[i]);
+		if (IS_ERR(tbs[i].task)) {
+			pr_alert("could not start thread on cpu %d\n", cpus[i]);
+			tbs[i].task = NULL;
+			err = 1;
+			break;
+		}
+		kthread_bind(tbs[i].task, cpus[i]);
+		wake_up_process(tbs[i].task);
+	}
+
+	/* release the started threads together, even if not all of them came up */
+	started = i;
+	for (j = 0; j < started; j++)
+		wait_for_completion(&tbs[j].ready);
+	complete_all(&threads_go);
+	for (j = 0; j < started; j++) {
+		wait_for_completion(&tbs[j].done);
+		kthread_stop(tbs[j].task);
+	}
+
+	for (j = 0; j < started; j++) {
+		if (tbs[j].err && !state)
+			state = tbs[j].err;
+		wall = max(wall, tbs[j].time);
+		ctx_init_ns += tbs[j].ctx_init_ns;
+		bytes += tbs[j].src_size * compbm.iterations;
+		stats_compute(&tbs[j].stats);
+		for (i = 0; i < tbs[j].stats.count; i++)
+			stats_add(&all, tbs[j].stats.samples[i]);
+		pr_alert("threads %d cpu %d %s %llu MB/s\n", n, tbs[j].cpu, state_names[tbs[j].err],
+		         stats_mbps(tbs[j].src_size * compbm.iterations, tbs[j].time));
+	}
+	pr_alert("threads %d %s %s %s aggregate %llu MB/s\n", n, compbm.mem.name, compbm.transform.name,
+	         compbm.compress.name, stats_mbps(bytes, wall));
+
+	/* one record per thread count, compress samples are those of all threads */
+	stats_compute(&all);
+	result = (struct result) {
+		.cpu = cpus[0],
+		.node = cpu_to_node(cpus[0]),
+		.threads = n,
+		.mem = compbm.mem.name,
+		.transform = compbm.compress.type == POINTER ? compbm.transform.name : NULL,
+		.compress = compbm.compress.name,
+		.state = state_names[state],
+		.path = compbm.path,
+		.level = compbm.compress.level,
+		.input_size = tbs[0].src_size,
+		.compressed_size = tbs[0].compressed_size,
+		.block_size = compbm.mem.format == BLOCK_ARRAY && tbs[0].err != BUFFER
+		              ? tbs[0].buffer.block_array.block_size : 0,
+		.workspace = tbs[0].workspace,
+		.ctx_init_ns = ctx_init_ns,
+		.iterations = compbm.iterations,
+		.warmup = compbm.warmup,
+	};
+	result.stats[COMPRESS_PHASE] = all;
+	account_get(result.memory);
+	mem_arena_get(&result.arena);
+	results_add(&result);
+	if (state)
+		err = 1;
+
+	for (j = 0; j < n; j++)
+		if (tbs[j].task)
+			thread_teardown(&tbs[j]);
+	stats_free(&all);
+	kfree(tbs);
+	return err;
+}
+
+/* scale from 1 to all cpus of cpulist with the selected mem/transform/compress */
+int threads_run(char *cpulist) {
+	cpumask_var_t mask;
+	int *cpus, cpu, n = 0, err = 0;
+
+	if (!compbm.input || !compbm.mem.name || !compbm.compress.name) {
+		pr_alert("no input, format or compression selected\n");
+		return 1;
+	}
+	if (compbm.compress.type == POINTER && (!compbm.transform.name || compbm.mem.format != compbm.transform.format)) {
+		pr_alert("no matching transformation selected\n");
+		return 1;
+	}
+	if (compbm.compress.type != POINTER && compbm.compress.type != compbm.mem.format) {
+		pr_alert("compression %s not working with %s\n", compbm.compress.name, compbm.mem.name);
+		return 1;
+	}
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return 1;
+	if (cpulist_parse(cpulist, mask)) {
+		pr_alert("invalid cpu list %s\n", cpulist);
+		free_cpumask_var(mask);
+		return 1;
+	}
+	cpumask_and(mask, mask, cpu_online_mask);
+	if (!(cpus = kmalloc_array(cpumask_weight(mask), sizeof(int), GFP_KERNEL))) {
+		free_cpumask_var(mask);
+		return 1;
+	}
+	for_each_cpu(cpu, mask)
+		cpus[n++] = cpu;
+	free_cpumask_var(mask);
+
+	for (cpu = 1; !err && cpu <= n; cpu++)
+		err = threads_run_n(cpus, cpu);
+
+	kfree(cpus);
+	return err;
+}
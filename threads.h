@@ -0,0 +1,7 @@
+#ifndef threads_h_INCLUDED
+#define threads_h_INCLUDED
+
+/* scaling benchmark, one pinned kthread per cpu in cpulist */
+int threads_run(char *cpulist);
+
+#endif // threads_h_INCLUDED
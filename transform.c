@@ -1,11 +1,18 @@
 #include <linux/slab.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/scatterlist.h>
 #include <linux/smp.h>
+#include <linux/uio.h>
 #include <linux/vmalloc.h>
 
+#ifdef COMPBM_ABD
+#include "zfs/include/sys/abd.h"
+#endif
+
 #include "mem.h"
 #include "transform.h"
+#include "account.h"
 
 #define SIZE(a) (sizeof(a)/sizeof(*a))
 
@@ -26,26 +33,39 @@ void transform_pointer_dummy_free(union buffer *buffer, void *data) {
 void * transform_pointer_vmalloc_init(union buffer *buffer) {
 	void *ret;
 	struct pointer *bp = &buffer->pointer;
-	if (!(ret = vmalloc(bp->ps)))
+	if (!(ret = account_vmalloc(bp->ps)))
 		return NULL;
 	memcpy(ret, bp->p, bp->ps);
 	return ret;
 }
 void transform_pointer_vmalloc_free(union buffer *buffer, void *data) {
-	if (data) vfree(data);
+	account_vfree(data, buffer->pointer.ps);
+}
+
+/* vmalloc_huge dupe */
+void * transform_pointer_vmalloc_huge_init(union buffer *buffer) {
+	void *ret;
+	struct pointer *bp = &buffer->pointer;
+	if (!(ret = account_vmalloc_huge(bp->ps)))
+		return NULL;
+	memcpy(ret, bp->p, bp->ps);
+	return ret;
+}
+void transform_pointer_vmalloc_huge_free(union buffer *buffer, void *data) {
+	account_vfree_huge(data, buffer->pointer.ps);
 }
 
 /* kmalloc dupe */
 void * transform_pointer_kmalloc_init(union buffer *buffer) {
 	void *ret;
 	struct pointer *bp = &buffer->pointer;
-	if (!(ret = kmalloc(bp->ps, GFP_KERNEL)))
+	if (!(ret = account_kmalloc(bp->ps, GFP_KERNEL)))
 		return NULL;
 	memcpy(ret, bp->p, bp->ps);
 	return ret;
 }
 void transform_pointer_kmalloc_free(union buffer *buffer, void *data) {
-	if (data) kfree(data);
+	account_kfree(data);
 }
 
 /* -----------------
@@ -57,7 +77,7 @@ void * transform_pages_vmalloc_init(union buffer *buffer) {
 	struct page_array *bpa = &buffer->page_array;
 	void *ret;
 	int i;
-	if (!(ret = vmalloc(bpa->ps * PAGE_SIZE)))
+	if (!(ret = account_vmalloc(bpa->ps * PAGE_SIZE)))
 		return NULL;
 	for (i = 0; i < bpa->ps; i++)
 		memcpy(ret + i * PAGE_SIZE,
@@ -66,7 +86,24 @@ void * transform_pages_vmalloc_init(union buffer *buffer) {
 	return ret;
 }
 void transform_pages_vmalloc_free(union buffer *buffer, void *data) {
-	if (data) vfree(data);
+	account_vfree(data, buffer->page_array.ps * PAGE_SIZE);
+}
+
+/* pages vmalloc_huge dupe */
+void * transform_pages_vmalloc_huge_init(union buffer *buffer) {
+	struct page_array *bpa = &buffer->page_array;
+	void *ret;
+	int i;
+	if (!(ret = account_vmalloc_huge(bpa->ps * PAGE_SIZE)))
+		return NULL;
+	for (i = 0; i < bpa->ps; i++)
+		memcpy(ret + i * PAGE_SIZE,
+           page_address(bpa->p[i]),
+           PAGE_SIZE);
+	return ret;
+}
+void transform_pages_vmalloc_huge_free(union buffer *buffer, void *data) {
+	account_vfree_huge(data, buffer->page_array.ps * PAGE_SIZE);
 }
 
 /* pages kmalloc dupe */
@@ -74,7 +111,7 @@ void * transform_pages_kmalloc_init(union buffer *buffer) {
 	struct page_array *bpa = &buffer->page_array;
 	void *ret;
 	int i;
-	if (!(ret = kmalloc(bpa->ps * PAGE_SIZE, GFP_KERNEL)))
+	if (!(ret = account_kmalloc(bpa->ps * PAGE_SIZE, GFP_KERNEL)))
 		return NULL;
 	for (i = 0; i < bpa->ps; i++)
 		memcpy(ret + i * PAGE_SIZE,
@@ -83,32 +120,32 @@ void * transform_pages_kmalloc_init(union buffer *buffer) {
 	return ret;
 }
 void transform_pages_kmalloc_free(union buffer *buffer, void *data) {
-	if (data) kfree(data);
+	account_kfree(data);
 }
 
 /* vmap pages */
 void * transform_pages_vmap_init(union buffer *buffer) {
 	struct page_array *bpa = &buffer->page_array;
 	void *ret;
-	if (!(ret = vmap(bpa->p, bpa->ps, VM_MAP, PAGE_KERNEL)))
+	if (!(ret = account_vmap(bpa->p, bpa->ps)))
 		return NULL;
 	return ret;
 }
 void transform_pages_vmap_free(union buffer *buffer, void *data) {
-	if (data) vunmap(data);
+	account_vunmap(data, buffer->page_array.ps);
 }
 
 /* vm_map_ram pages */
 void * transform_pages_vm_map_ram_init(union buffer *buffer) {
 	struct page_array *bpa = &buffer->page_array;
 	void *ret;
-	if (!(ret = vm_map_ram(bpa->p, bpa->ps, get_cpu(), PAGE_KERNEL)))
+	if (!(ret = account_vm_map_ram(bpa->p, bpa->ps, NUMA_NO_NODE)))
 		return NULL;
 	return ret;
 }
 void transform_pages_vm_map_ram_free(union buffer *buffer, void *data) {
 	struct page_array *bpa = &buffer->page_array;
-	if (data) vm_unmap_ram(data, bpa->ps);
+	account_vm_unmap_ram(data, bpa->ps);
 }
 
 /* ------------------
@@ -120,14 +157,31 @@ void * transform_blocks_vmalloc_init(union buffer *buffer) {
 	struct block_array *bba = &buffer->block_array;
 	void *ret;
 	int i;
-	if (!(ret = vmalloc(bba->bs * bba->block_size)))
+	if (!(ret = account_vmalloc(bba->bs * bba->block_size)))
 		return NULL;
 	for (i = 0; i < bba->bs; i++)
 		memcpy(ret + i * bba->block_size, bba->b[i], bba->block_size);
 	return ret;
 }
 void transform_blocks_vmalloc_free(union buffer *buffer, void *data) {
-	if (data) vfree(data);
+	struct block_array *bba = &buffer->block_array;
+	account_vfree(data, bba->bs * bba->block_size);
+}
+
+/* vmalloc_huge dupe */
+void * transform_blocks_vmalloc_huge_init(union buffer *buffer) {
+	struct block_array *bba = &buffer->block_array;
+	void *ret;
+	int i;
+	if (!(ret = account_vmalloc_huge(bba->bs * bba->block_size)))
+		return NULL;
+	for (i = 0; i < bba->bs; i++)
+		memcpy(ret + i * bba->block_size, bba->b[i], bba->block_size);
+	return ret;
+}
+void transform_blocks_vmalloc_huge_free(union buffer *buffer, void *data) {
+	struct block_array *bba = &buffer->block_array;
+	account_vfree_huge(data, bba->bs * bba->block_size);
 }
 
 /* kmalloc dupe */
@@ -135,27 +189,101 @@ void * transform_blocks_kmalloc_init(union buffer *buffer) {
 	struct block_array *bba = &buffer->block_array;
 	void *ret;
 	int i;
-	if (!(ret = kmalloc(bba->bs * bba->block_size, GFP_KERNEL)))
+	if (!(ret = account_kmalloc(bba->bs * bba->block_size, GFP_KERNEL)))
 		return NULL;
 	for (i = 0; i < bba->bs; i++)
 		memcpy(ret + i * bba->block_size, bba->b[i], bba->block_size);
 	return ret;
 }
 void transform_blocks_kmalloc_free(union buffer *buffer, void *data) {
-	if (data) kfree(data);
+	account_kfree(data);
+}
+
+/* ------------------
+ * scatterlist buffer
+ * ------------------ */
+
+/* linearize with sg_copy_to_buffer, walking the list like a codec would */
+void * transform_sg_vmalloc_init(union buffer *buffer) {
+	struct sg_list *bsg = &buffer->sg_list;
+	void *ret;
+	size_t size = bsg->ps * PAGE_SIZE;
+	if (!(ret = account_vmalloc(size)))
+		return NULL;
+	sg_copy_to_buffer(bsg->sg, bsg->nents, ret, size);
+	return ret;
+}
+void transform_sg_vmalloc_free(union buffer *buffer, void *data) {
+	account_vfree(data, buffer->sg_list.ps * PAGE_SIZE);
+}
+
+/* vmap the backing pages, entries are packed into them in order */
+void * transform_sg_vmap_init(union buffer *buffer) {
+	struct sg_list *bsg = &buffer->sg_list;
+	return account_vmap(bsg->p, bsg->ps);
+}
+void transform_sg_vmap_free(union buffer *buffer, void *data) {
+	account_vunmap(data, buffer->sg_list.ps);
+}
+
+/* -------------
+ * bio_vec array
+ * ------------- */
+
+/* linearize through the iov_iter, like a driver bouncing a bio */
+void * transform_bvec_vmalloc_init(union buffer *buffer) {
+	struct bvec_array *bbv = &buffer->bvec_array;
+	struct iov_iter iter;
+	void *ret;
+	if (!(ret = account_vmalloc(bbv->size)))
+		return NULL;
+	mem_bvec_iter(&iter, buffer, WRITE);
+	if (copy_from_iter(ret, bbv->size, &iter) != bbv->size) {
+		account_vfree(ret, bbv->size);
+		return NULL;
+	}
+	return ret;
 }
+void transform_bvec_vmalloc_free(union buffer *buffer, void *data) {
+	account_vfree(data, buffer->bvec_array.size);
+}
+
+#ifdef COMPBM_ABD
+/* -------
+ * zfs abd
+ * ------- */
+
+/* what zio_compress_data does, a copy for scatter abds, free for linear ones */
+void * transform_abd_borrow_init(union buffer *buffer) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	return abd_borrow_buf_copy(bab->abd, bab->size);
+}
+void transform_abd_borrow_free(union buffer *buffer, void *data) {
+	struct abd_buffer *bab = &buffer->abd_buffer;
+	if (data) abd_return_buf(bab->abd, data, bab->size);
+}
+#endif
 
 struct transform_api transform_formats[] = {
 // list_start
 	{POINTER, "pointer_dummy", transform_pointer_dummy_init, transform_pointer_dummy_free},
 	{POINTER, "pointer_vmalloc", transform_pointer_vmalloc_init, transform_pointer_vmalloc_free},
+	{POINTER, "pointer_vmalloc_huge", transform_pointer_vmalloc_huge_init, transform_pointer_vmalloc_huge_free},
 	{POINTER, "pointer_kmalloc", transform_pointer_kmalloc_init, transform_pointer_kmalloc_free},
 	{PAGE_ARRAY, "pages_vmalloc", transform_pages_vmalloc_init, transform_pages_vmalloc_free},
+	{PAGE_ARRAY, "pages_vmalloc_huge", transform_pages_vmalloc_huge_init, transform_pages_vmalloc_huge_free},
 	{PAGE_ARRAY, "pages_kmalloc", transform_pages_kmalloc_init, transform_pages_kmalloc_free},
 	{PAGE_ARRAY, "pages_vmap", transform_pages_vmap_init, transform_pages_vmap_free},
 	{PAGE_ARRAY, "pages_vm_map_ram", transform_pages_vm_map_ram_init, transform_pages_vm_map_ram_free},
 	{BLOCK_ARRAY, "blocks_vmalloc", transform_blocks_vmalloc_init, transform_blocks_vmalloc_free},
+	{BLOCK_ARRAY, "blocks_vmalloc_huge", transform_blocks_vmalloc_huge_init, transform_blocks_vmalloc_huge_free},
 	{BLOCK_ARRAY, "blocks_kmalloc", transform_blocks_kmalloc_init, transform_blocks_kmalloc_free},
+	{SG_LIST, "sg_vmalloc", transform_sg_vmalloc_init, transform_sg_vmalloc_free},
+	{SG_LIST, "sg_vmap", transform_sg_vmap_init, transform_sg_vmap_free},
+	{BVEC, "bvec_vmalloc", transform_bvec_vmalloc_init, transform_bvec_vmalloc_free},
+#ifdef COMPBM_ABD
+	{ABD, "abd_borrow", transform_abd_borrow_init, transform_abd_borrow_free},
+#endif
 // list_end
 };
 
@@ -168,3 +296,11 @@ int transform_choose(char *name, struct transform_api *transform_api) {
 		}
 	return i == SIZE(transform_formats);
 }
+
+/* i-th entry of transform_formats, used to walk the whole list */
+int transform_nth(int i, struct transform_api *transform_api) {
+	if (i < 0 || i >= SIZE(transform_formats))
+		return 1;
+	*transform_api = transform_formats[i];
+	return 0;
+}
@@ -14,6 +14,7 @@ struct transform_api {
 };
 
 int transform_choose(char *name, struct transform_api *transform_api);
+int transform_nth(int i, struct transform_api *transform_api);
 
 #endif // transform_h_INCLUDED
 